@@ -5,6 +5,38 @@
 #include "types.h"
 #include "eval.h"
 
-Move iterative_deepening(TranspoTable *tt, PositionList *board_history, Color color, int max_depth, double max_time);
+#define NULL_MOVE_MIN_DEPTH 3     // depth left from which the null move is tried
+#define NULL_MOVE_REDUCTION 3     // plies taken off the null move search, on top of the move itself
+#define NULL_MOVE_DEPTH_DIVISOR 4 // and one more ply every that many plies of depth left
+#define LMR_MIN_DEPTH 3           // depth left from which the late quiet moves are reduced
+#define LMR_MIN_MOVES 3           // moves searched at full depth before the reductions start
+#define LMR_BASE 0.75             // reduction = LMR_BASE + log(depth left) * log(moves searched) / LMR_DIVISOR
+#define LMR_DIVISOR 2.25
+#define ASPIRATION_MIN_DEPTH 4    // iterations before it are searched with the whole window
+#define ASPIRATION_WINDOW 25      // half width of the first root window around the previous score, grows by half at each fail
+// defaults of the pruning near the leaves, all can be changed with setoption to be tuned
+#define RFP_MAX_DEPTH 6           // depth left up to which a node whose static eval beats the bound by the margin is cut
+#define RFP_MARGIN 80             // reverse futility margin, per ply of depth left
+#define RAZOR_MAX_DEPTH 2         // depth left up to which a node far below the bound goes to the quiescence search
+#define RAZOR_MARGIN 300          // razoring margin, per ply of depth left
+#define FUTILITY_MAX_DEPTH 3      // depth left up to which the quiet moves that can't reach the bound are skipped
+#define FUTILITY_BASE 50          // futility margin = FUTILITY_BASE + FUTILITY_MARGIN * depth left
+#define FUTILITY_MARGIN 100
+#define LMP_MAX_DEPTH 4           // depth left up to which the late quiet moves are skipped
+#define LMP_BASE 3                // moves searched before that: LMP_BASE + depth left * depth left
+#define SEE_PRUNE_MAX_DEPTH 4     // depth left up to which the captures losing too much by SEE are skipped
+#define SEE_PRUNE_MARGIN 100      // material a losing capture may give up, per ply of depth left
+
+void set_search_threads(int threads);
+int get_search_threads();
+bool set_search_param(const char *name, int value);
+void print_search_params();
+void clear_search_tables();
+void prepare_search(bool ponder);
+void stop_search();
+void ponderhit();
+Move iterative_deepening(TranspoTable *tt, PositionList *board_history, SearchLimits *limits);
+SearchContext *new_search_context();
+Move search_position(SearchContext *ctx, TranspoTable *tt, PositionList *board_history, SearchLimits *limits, int *score);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,11 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "types.h"
+
+#define BENCH_DEFAULT_DEPTH 6 // about ten seconds for the whole set
+#define BENCH_HASH_MB 16
+
+void bench(int depth);
+
+#endif
@@ -18,9 +18,18 @@ Bitboard init_black_queens();
 Bitboard init_white_kings();
 Bitboard init_black_kings();
 
-MoveList *possible_moves_bb(BoardState *board_s);
+MoveList *possible_moves_bb(BoardState *board_s, MoveList *move_list);
+MoveList *possible_captures_bb(BoardState *board_s, MoveList *move_list);
+MoveList *possible_quiets_bb(BoardState *board_s, MoveList *move_list);
+bool is_pseudo_legal(BoardState *board_s, Move move);
+bool is_legal(BoardState *board_s, Move move);
+bool is_legal_move(BoardState *board_s, Move move);
 
-Bitboard get_attacks(BoardState *board_s);
+void init_bitboard_tables();
+Bitboard get_white_pawn_attacks(Bitboard pawns);
+Bitboard get_black_pawn_attacks(Bitboard pawns);
+Bitboard attackers_to(BoardState *board_s, int square, Bitboard occupancy);
+Bitboard get_attacks_by(BoardState *board_s, Color color, Bitboard ignored);
 bool is_king_in_check(BoardState *board_s);
 bool is_mate_bb(BoardState *board_s);
 
@@ -10,12 +10,55 @@ BoardState *init_board();
 BoardState *FEN_to_board(char *FEN);
 Piece empty_piece();
 Coords empty_coords();
-Move empty_move();
 bool is_empty(Piece piece);
 bool is_empty_coords(Coords coords);
-bool is_empty_move(Move move);
 int coords_to_square(Coords co);
 Coords square_to_coords(int square);
+
+// packed moves, see Move in types.h
+// inline because the search reads them in every node
+static inline Move create_move(int init_square, int dest_square, PieceType promotion)
+{
+    return (Move)(init_square | dest_square << 6 | (promotion == EMPTY_PIECE ? 0 : promotion << 12));
+}
+
+static inline Move empty_move()
+{
+    return 0;
+}
+
+static inline bool is_empty_move(Move move)
+{
+    return move == 0;
+}
+
+static inline int move_init_square(Move move)
+{
+    return move & 0x3F;
+}
+
+static inline int move_dest_square(Move move)
+{
+    return (move >> 6) & 0x3F;
+}
+
+static inline PieceType move_promotion(Move move)
+{
+    return (move >> 12) ? (PieceType)(move >> 12) : EMPTY_PIECE;
+}
+
+static inline Coords move_init_coords(Move move)
+{
+    return (Coords){move_init_square(move) / 8, 7 - move_init_square(move) % 8};
+}
+
+static inline Coords move_dest_coords(Move move)
+{
+    return (Coords){move_dest_square(move) / 8, 7 - move_dest_square(move) % 8};
+}
+
+Move coords_to_move(Coords init_coords, Coords dest_coords, PieceType promotion);
+void move_to_uci(Move move, char *str);
 PieceType char_to_piece_type(char c);
 char piece_type_to_char(PieceType type);
 PositionList *empty_list();
@@ -32,5 +75,9 @@ BoardState *move_pawn_handling(BoardState *board_s, Piece move_piece, Piece dest
 BoardState *move_king_handling(BoardState *board_s, Piece move_piece, Coords init_coords, Coords new_coords);
 BoardState *move_rook_handling(BoardState *board_s, Piece move_piece, Coords init_coords, Coords new_coords);
 BoardState *move_piece(BoardState *board_s, Move sel_move);
+void make_move(BoardState *board_s, Move sel_move, UndoInfo *undo);
+void unmake_move(BoardState *board_s, UndoInfo *undo);
+void make_null_move(BoardState *board_s, UndoInfo *undo);
+void unmake_null_move(BoardState *board_s, UndoInfo *undo);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,14 @@
+#ifndef DATAGEN_H
+#define DATAGEN_H
+
+#include "types.h"
+
+#define DATAGEN_HASH_MB 8           // transposition table of each game thread, shared by both colors
+#define DATAGEN_MAX_PLIES 400       // a longer game is a draw
+#define DATAGEN_MAX_OPENING_SCORE 400 // random openings more unbalanced than this are played again
+
+void datagen_default_options(DatagenOptions *options);
+void run_datagen(DatagenOptions *options);
+BoardState *record_to_board(DataRecord *record);
+
+#endif
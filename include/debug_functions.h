@@ -14,5 +14,7 @@ bool are_same_move_set(MoveList *move_list, MoveList *move_list_bb);
 void print_differences(MoveList *move_list, MoveList *move_list_bb);
 void verify_and_print_differences(MoveList *move_list, MoveList *move_list_bb, PositionList *board_history, Color color);
 void print_board_state_full(BoardState *board_s);
+void compare_pawn_evals(int nb_positions);
+void compare_evals(int nb_positions);
 
 #endif
\ No newline at end of file
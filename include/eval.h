@@ -4,7 +4,46 @@
 #include <stdlib.h>
 #include "types.h"
 
-int eval(PositionList *board_history);
+// a middle game and an endgame score packed in one int, so that both are updated with one addition
+// the endgame part takes the high bits, the borrow of a negative middle game part is undone when reading it
+static inline int32_t make_score(int mg, int eg)
+{
+    return (int32_t)((uint32_t)eg << 16) + mg;
+}
+
+static inline int mg_value(int32_t score)
+{
+    return (int16_t)(uint16_t)(uint32_t)score;
+}
+
+static inline int eg_value(int32_t score)
+{
+    return (int16_t)(uint16_t)((uint32_t)(score + 0x8000) >> 16);
+}
+
+// packed score of each piece on each square, material included, negative for black
+extern int32_t psq_table[2][6][8][8];
+
+// the hand set weights, what the tuner starts from
+extern const int PIECES_VALUES_MG[6];
+extern const int PIECES_VALUES_EG[6];
+extern const int (*PESTO_TABLE_MG[6])[8];
+extern const int (*PESTO_TABLE_EG[6])[8];
+extern const int passed_pawn_bonus[8];
+extern const int ISOLATED_PAWN_PENALTY;
+extern const int DOUBLED_PAWN_PENALTY;
+extern const int PROTECTED_PAWN_BONUS;
+extern const int CASTLING_RIGHTS_BONUS;
+extern const int UNCASTLED_KING_PENALTY;
+
+int eval(BoardState *board_s, PawnTable *pawn_table);
 void init_eval_tables();
+int pawn_structure_eval(BoardState *board_s);
+int pawn_structure_eval_setwise(BoardState *board_s);
+void clear_pawn_table(PawnTable *table);
+PawnEntry *probe_pawn_table(BoardState *board_s, PawnTable *table);
+int32_t compute_psqt(BoardState *board_s);
+void pawn_structure_terms(BoardState *board_s, PawnTermCounts counts[2]);
+void castle_terms(BoardState *board_s, int rights[2], int uncastled[2]);
 
 #endif
\ No newline at end of file
@@ -4,5 +4,6 @@
 #include "types.h"
 
 void handle_uci_command(char *command, TranspoTable *tt, PositionList *board_history);
+void finish_search();
 
 #endif
\ No newline at end of file
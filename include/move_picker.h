@@ -0,0 +1,16 @@
+#ifndef MOVE_PICKER_H
+#define MOVE_PICKER_H
+
+#include "types.h"
+
+#define HISTORY_MAX 16384
+
+void init_move_picker(MovePicker *picker, SearchContext *ctx, int depth, MoveList *move_list, Move tt_move, bool captures_only);
+Move next_move(MovePicker *picker);
+int mvv_lva(BoardState *board_s, Move move);
+bool is_quiet_move(BoardState *board_s, Move move);
+void update_quiet_stats(SearchContext *ctx, int depth, int depth_to_go, Move best, Move *quiets_tried, int nb_quiets_tried);
+void age_ordering_tables(SearchContext *ctx);
+void clear_ordering_tables(SearchContext *ctx);
+
+#endif
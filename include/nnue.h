@@ -0,0 +1,27 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <stdbool.h>
+#include "types.h"
+
+// network file, little endian:
+//   uint32 magic "FNUE", uint32 NNUE_INPUTS, uint32 NNUE_HIDDEN
+//   int16 feature weights[NNUE_INPUTS][NNUE_HIDDEN], int16 feature biases[NNUE_HIDDEN]
+//   int8 output weights[2 * NNUE_HIDDEN] (side to move first), int32 output bias
+// the accumulator is clipped to [0, NNUE_QA], the output is scaled by NNUE_SCALE / (NNUE_QA * NNUE_QB)
+#define NNUE_MAGIC 0x45554E46
+#define NNUE_QA 127
+#define NNUE_QB 64
+#define NNUE_SCALE 400
+#define NNUE_MAX_EVAL (MAX_SCORE / 2)
+
+bool nnue_load(const char *path);
+void nnue_load_random(uint64_t seed);
+void nnue_unload();
+bool nnue_enabled();
+const char *nnue_kernel_name();
+void nnue_refresh(NnueAccumulator *acc, BoardState *board_s);
+void nnue_update(NnueAccumulator *acc, NnueAccumulator *parent, UndoInfo *undo);
+int nnue_evaluate(NnueAccumulator *acc, Color player);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef PERFT_H
+#define PERFT_H
+
+#include "types.h"
+
+uint64_t perft(BoardState *board_s, int depth);
+bool init_perft_table(PerftTable *table, size_t size_mb);
+void free_perft_table(PerftTable *table);
+uint64_t perft_divide(BoardState *board_s, int depth, int threads, PerftTable *table, bool divide);
+void perft_report(BoardState *board_s, int depth);
+void perft_divide_report(BoardState *board_s, int depth, int threads, size_t hash_mb);
+bool perft_suite(int threads, size_t hash_mb, bool deep);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef SEE_H
+#define SEE_H
+
+#include "types.h"
+
+int see(BoardState *board_s, Move move);
+bool see_suite();
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef TIME_MANAGER_H
+#define TIME_MANAGER_H
+
+#include "types.h"
+
+#define TIME_CHECK_INTERVAL 1024
+
+double get_time();
+void init_time_manager(TimeManager *tm, SearchLimits *limits, Color color, atomic_bool *pondering);
+bool is_pondering(TimeManager *tm);
+bool time_is_up(TimeManager *tm, uint64_t nodes);
+bool can_start_iteration(TimeManager *tm, double last_iteration_time, double previous_iteration_time);
+
+#endif
@@ -3,10 +3,17 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdatomic.h>
 
 #define MAX_SEARCH_PLY 128
+#define MAX_GAME_KEYS 256 // game positions kept for repetitions, more than the 150 plies of the 75 move rule
+#define MAX_THREADS 256
 #define MAX_MOVES 128
-#define MAX_SCORE 100050
+#define MAX_SCORE 32000 // fits the 16 bits of a transposition table score
+#define TT_BUCKET_ENTRIES 8
+#define PAWN_TABLE_SIZE 16384 // entries of the pawn table of each search thread, a power of 2
+#define NNUE_INPUTS 768         // color, piece type and square of each piece, seen from each side
+#define NNUE_HIDDEN 256         // accumulator size of one side
 
 typedef int Score;
 
@@ -42,12 +49,10 @@ typedef struct
     int y;
 } Coords;
 
-typedef struct
-{
-    Coords init_co;
-    Coords dest_co;
-    PieceType promotion;
-} Move;
+// a move packed in 16 bits: initial square (bits 0-5), destination square (bits 6-11) and promotion (bits 12-14, 0 if none)
+// the squares use the bitboard numbering (h1 = 0, a1 = 7, a8 = 63), 0 is the empty move since h1 to h1 can't be played
+// Coords only come back at the UCI boundary and for the board array
+typedef uint16_t Move;
 
 typedef struct
 {
@@ -65,9 +70,30 @@ typedef struct
     Bitboard color_bb[2];
     Bitboard all_pieces_bb[2][6];
     uint64_t hash;
+    uint64_t pawn_hash; // zobrist keys of the pawns only, the index of the pawn table
     int phase;
+    int32_t psqt; // packed middle game and endgame piece square score with material, for white
 } BoardState;
 
+// what make_move saves to let unmake_move restore the previous board
+typedef struct
+{
+    Move move;
+    Piece moved;
+    Piece captured;
+    bool white_kingside_castlable;
+    bool white_queenside_castlable;
+    bool black_kingside_castlable;
+    bool black_queenside_castlable;
+    int8_t white_pawn_passant;
+    int8_t black_pawn_passant;
+    int fifty_move_rule;
+    uint64_t hash;
+    uint64_t pawn_hash;
+    int phase;
+    int32_t psqt;
+} UndoInfo;
+
 typedef struct position_list
 {
     BoardState *board_s;
@@ -87,19 +113,208 @@ typedef enum : uint8_t
     UPPERBOUND
 } Flag;
 
+// an entry packed in one 64 bits word, read and written in one go so that the threads never see half an entry:
+// key (16 high bits of the hash) | move (16) | score (16) | depth (8) | generation (6) | flag (2)
+typedef _Atomic uint64_t TranspoTableEntry;
+
+// a bucket fills exactly one cache line, a probe touches a single line
 typedef struct
 {
-    uint64_t hash;
-    Score score;
-    int depth;
-    Move best_move;
-    Flag flag;
-} TranspoTableEntry;
+    _Alignas(64) TranspoTableEntry entries[TT_BUCKET_ENTRIES];
+} TranspoTableBucket;
 
 typedef struct
 {
-    size_t size;
-    TranspoTableEntry *entries;
+    size_t size;        // number of buckets, a power of two
+    uint8_t generation; // bumped at each search, entries of older searches are replaced first
+    TranspoTableBucket *buckets;
+    void *memory;       // the mapping holding the buckets, with its size, for munmap
+    size_t memory_size;
 } TranspoTable;
 
+typedef enum : uint8_t
+{
+    STAGE_TT_MOVE,
+    STAGE_INIT_CAPTURES,
+    STAGE_CAPTURES,
+    STAGE_INIT_QUIETS,
+    STAGE_QUIETS,
+    STAGE_BAD_CAPTURES,
+    STAGE_DONE
+} PickerStage;
+
+// hands out the moves of a node one at a time, each stage is generated only when the previous one is used up
+typedef struct
+{
+    BoardState *board_s;
+    MoveList *move_list; // storage given by the search, reused by every stage
+    int scores[MAX_MOVES];
+    int index;
+    Move tt_move;
+    Move killers[2];     // quiet moves that refuted a sibling node, ordered after the captures
+    Move countermove;    // quiet move that last refuted the previous move
+    int (*history)[64];  // butterfly history of the player to move, by from and to square
+    Move bad_captures[MAX_MOVES]; // captures losing material by SEE, kept for after the quiet moves
+    int nb_bad_captures;
+    int bad_index;
+    bool captures_only;
+    PickerStage stage;
+} MovePicker;
+
+// what the eval knows about a pawn structure, whatever the other pieces are
+typedef struct
+{
+    uint64_t key;
+    Bitboard passed[2];      // pawns with no enemy pawn in front of them on their file or the adjacent ones
+    Bitboard attack_span[2]; // every square the pawns of a color may attack while advancing
+    int score;               // pawn structure score for white
+} PawnEntry;
+
+// how many pawns of a color get each term of the pawn structure eval
+typedef struct
+{
+    int isolated;
+    int doubled;
+    int protected;
+    int passed[8]; // by advancement, the rank seen from the pawn's side
+} PawnTermCounts;
+
+typedef struct
+{
+    PawnEntry entries[PAWN_TABLE_SIZE];
+    uint64_t probes;
+    uint64_t hits;
+} PawnTable;
+
+// what the go command asks for, 0 for what it doesn't give
+typedef struct
+{
+    double time[2];      // wtime and btime in seconds, -1 for infinite
+    double increment[2]; // winc and binc in seconds
+    int movestogo;
+    double movetime;     // seconds
+    int depth;
+    uint64_t nodes;
+    int mate;            // look for a mate in that many moves
+    bool infinite;
+    bool ponder;         // search on the opponent's time until ponderhit or stop
+} SearchLimits;
+
+// limits of one search, on the monotonic clock
+typedef struct
+{
+    double start_time;
+    double soft_limit;  // no new iteration is started past it
+    double hard_limit;  // the search is aborted past it
+    uint64_t max_nodes; // 0 for no limit
+    bool timed;         // false for go infinite, depth, nodes or mate without a clock
+    bool ponder;        // the limits only apply once the ponder search is converted
+    atomic_bool *pondering; // cleared by ponderhit or stop from the uci thread
+} TimeManager;
+
+// a go command handed to the search thread
+typedef struct
+{
+    TranspoTable *tt;
+    PositionList *board_history;
+    SearchLimits limits;
+} SearchJob;
+
+// perft results by position and depth, shared by the perft threads
+// the key is stored xored with the data so that an entry torn by two writers is just a miss
+typedef struct
+{
+    _Atomic uint64_t key;  // hash ^ data
+    _Atomic uint64_t data; // nodes << 8 | depth
+} PerftEntry;
+
+typedef struct
+{
+    PerftEntry *entries;
+    size_t size; // a power of two
+} PerftTable;
+
+// one position of a self-play game as written by datagen, 32 bytes, little endian
+typedef struct
+{
+    Bitboard occupancy;       // all the pieces, h1 = bit 0
+    uint8_t pieces[16];       // name + 6 * color of each piece of occupancy from the lowest bit, 4 bits each, low nibble first
+    int16_t score;            // search score for white
+    uint8_t result;           // for white: 0 loss, 1 draw, 2 win
+    uint8_t player;           // WHITE or BLACK to move
+    uint8_t castling;         // 1 white kingside, 2 white queenside, 4 black kingside, 8 black queenside
+    int8_t en_passant;        // column of the pawn that can be taken en passant, -1 if none
+    uint8_t fifty_move_rule;
+    uint8_t padding;
+} DataRecord;
+
+_Static_assert(sizeof(DataRecord) == 32, "datagen records are 32 bytes");
+
+// datagen command: where to write and how the games are played
+typedef struct
+{
+    char path[256];
+    uint64_t positions;   // positions in the file when done, the ones already there count
+    uint64_t nodes;       // per move
+    int threads;          // games played at once
+    int random_plies;     // random moves of each opening
+    uint64_t seed;
+} DatagenOptions;
+
+// first layer of the network for both points of view, the sum of the weights of the active features
+typedef struct
+{
+    int16_t values[2][NNUE_HIDDEN]; // by perspective, WHITE then BLACK
+    bool computed;                  // false until the move that led here has been applied
+} NnueAccumulator;
+
+// what the search keeps for each ply, preallocated so that a node never calls malloc
+typedef struct
+{
+    UndoInfo undo;
+    MoveList move_list;
+    NnueAccumulator accumulator; // of the position at this ply, only used with a network loaded
+} SearchStack;
+
+typedef struct
+{
+    TranspoTable *tt;            // shared by all the search threads
+    atomic_bool *stop;           // shared, raised by the main thread when the search must end
+    PositionList *game_history;  // shared and read only, its head is the root position
+    BoardState board;            // the thread's own board, moved with make_move/unmake_move
+    TimeManager *tm;             // shared, only the main thread checks it
+    int time_check_countdown;    // calls to search_stopped left before looking at the clock
+    int max_depth;
+    int thread_id;               // 0 is the main thread, the others are lazy SMP helpers
+    uint64_t nodes;
+    uint64_t qnodes;             // nodes reached by the quiescence search, not counted in nodes
+    uint64_t tt_probes;
+    uint64_t tt_hits;            // probes that found the position, with or without a cutoff
+    uint64_t tt_cutoffs;         // nodes answered by the table entry, before any move generation
+    uint64_t tt_move_cutoffs;    // cutoffs by the table move, searched before any move generation
+    uint64_t cutoffs;            // beta cutoffs of the main search
+    uint64_t first_move_cutoffs; // cutoffs given by the first move searched, measures the move ordering
+    // what each forward pruning removed: nodes cut for the first three, moves skipped for the others
+    uint64_t null_move_prunes;
+    uint64_t rfp_prunes;
+    uint64_t razor_prunes;
+    uint64_t futility_prunes;
+    uint64_t lmp_prunes;
+    uint64_t see_prunes;
+    uint64_t aspiration_researches; // root searches done again with a wider window
+    PawnTable pawn_table;        // the thread's own, kept from one search to the next
+    // quiet move ordering, kept by the thread from one go to the next and aged in between
+    Move killers[MAX_SEARCH_PLY][2];
+    int history[2][64][64];
+    Move countermoves[64][64];   // by the from and to square of the move to answer
+    SearchStack stack[MAX_SEARCH_PLY];
+    // hashes of the game positions since the last irreversible move, then of each ply from the root
+    uint64_t keys[MAX_GAME_KEYS + MAX_SEARCH_PLY];
+    int root_key;                // index of the root position in keys
+    // triangular pv table: pv[ply] holds the best line found from ply, up to pv_length[ply]
+    Move pv[MAX_SEARCH_PLY][MAX_SEARCH_PLY];
+    int pv_length[MAX_SEARCH_PLY];
+    Move root_move;              // best move of the last iteration, searched first by the next one
+} SearchContext;
+
 #endif
\ No newline at end of file
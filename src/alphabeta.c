@@ -1,7 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
+#include <string.h>
 #include <stdbool.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "types.h"
 #include "chess_logic.h"
@@ -10,238 +13,822 @@
 #include "bitboards_moves.h"
 #include "debug_functions.h"
 #include "transposition_tables.h"
+#include "move_picker.h"
+#include "time_manager.h"
+#include "nnue.h"
+#include "see.h"
 
-int alpha_beta_score(PositionList *board_history, Color color, int is_max)
+// copy the hashes of the game positions that can still repeat, the oldest first, then the root
+// the game history is shared by the threads and read only, each thread has its own keys
+static void load_game_keys(SearchContext *ctx)
 {
-    if ((is_max == 1 && color == WHITE) || (is_max == 0 && color == BLACK))
+    int limit = ctx->board.fifty_move_rule;
+    if (limit > MAX_GAME_KEYS - 1)
+        limit = MAX_GAME_KEYS - 1;
+    int count = 0;
+    for (PositionList *pos_l = ctx->game_history->tail; pos_l != NULL && count < limit; pos_l = pos_l->tail)
     {
-        return eval(board_history);
+        count++;
     }
-    else
+    ctx->root_key = count;
+    ctx->keys[count] = ctx->board.hash;
+    PositionList *pos_l = ctx->game_history->tail;
+    for (int i = count - 1; i >= 0; i--)
     {
-        return -eval(board_history);
+        ctx->keys[i] = pos_l->board_s->hash;
+        pos_l = pos_l->tail;
     }
 }
 
+// a position already met on the way from the root or in the game is considered a draw
+// nothing can repeat across an irreversible move, and the same player must be to move,
+// so only every other key since the last capture or pawn move is looked at
+static bool is_repetition(SearchContext *ctx, int depth)
+{
+    int current = ctx->root_key + depth;
+    int oldest = current - ctx->board.fifty_move_rule;
+    if (oldest < 0)
+        oldest = 0;
+    uint64_t hash = ctx->keys[current];
+    for (int i = current - 4; i >= oldest; i -= 2)
+    {
+        if (ctx->keys[i] == hash)
+        {
+            return true;
+        }
+    }
+    return false;
+}
 
-// do an optimized version of the possible moves function using bitboards
-// board_s is the current board state
-// color is the color of the player to move
-// return the list of possible moves
+
+static int search_threads = 1;
+
+void set_search_threads(int threads)
+{
+    if (threads < 1)
+        threads = 1;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+    search_threads = threads;
+}
+
+int get_search_threads()
+{
+    return search_threads;
+}
+
+// margins and depths of the pruning near the leaves, read by every search thread
+// only changed by setoption, between two searches
+static int rfp_max_depth = RFP_MAX_DEPTH;
+static int rfp_margin = RFP_MARGIN;
+static int razor_max_depth = RAZOR_MAX_DEPTH;
+static int razor_margin = RAZOR_MARGIN;
+static int futility_max_depth = FUTILITY_MAX_DEPTH;
+static int futility_base = FUTILITY_BASE;
+static int futility_margin = FUTILITY_MARGIN;
+static int lmp_max_depth = LMP_MAX_DEPTH;
+static int lmp_base = LMP_BASE;
+static int see_prune_max_depth = SEE_PRUNE_MAX_DEPTH;
+static int see_prune_margin = SEE_PRUNE_MARGIN;
 
 typedef struct
 {
-    Move move;
-    int score;
-} MoveScore;
-
-// do an alpha beta search
-
-// alpha is the best score that the maximizing player can guarantee
-// beta is the best score that the minimizing player can guarantee
-// depth is the depth of the search
-// max_depth is the maximum depth of the search
-// board_s is the current board state
-// color is the color of the player to move
-// tested_move is the move to make
-// is_max is true if the current player is the maximizing player
-// is_min is true if the current player is the minimizing player
-// nodes is the number of nodes checked
-// return the score of the best move
-
-MoveScore alphabeta(int alpha, int beta, int depth, int max_depth, TranspoTable *table, PositionList *board_history, Color color, Move tested_move, int is_max, int is_min, int *nodes, clock_t start_clk, double max_time, Move prio_move)
+    const char *name;
+    int *value;
+    int min;
+    int max;
+} SearchParam;
+
+static SearchParam search_params[] = {
+    {"RfpMaxDepth", &rfp_max_depth, 0, 16},
+    {"RfpMargin", &rfp_margin, 0, 1000},
+    {"RazorMaxDepth", &razor_max_depth, 0, 8},
+    {"RazorMargin", &razor_margin, 0, 2000},
+    {"FutilityMaxDepth", &futility_max_depth, 0, 8},
+    {"FutilityBase", &futility_base, 0, 1000},
+    {"FutilityMargin", &futility_margin, 0, 1000},
+    {"LmpMaxDepth", &lmp_max_depth, 0, 16},
+    {"LmpBase", &lmp_base, 0, 64},
+    {"SeePruneMaxDepth", &see_prune_max_depth, 0, 16},
+    {"SeePruneMargin", &see_prune_margin, 0, 1000},
+};
+
+// false if name is not a search parameter, the value is clamped to the range of the option
+bool set_search_param(const char *name, int value)
 {
-    *nodes = *nodes + 1;
-    MoveScore result;
-    result.move = tested_move;
-    if (threefold_hash(board_history->board_s->hash, board_history, 1) && depth > 0)
+    for (size_t i = 0; i < sizeof(search_params) / sizeof(search_params[0]); i++)
     {
-        result.score = 0;
-        return result;
+        if (strcmp(name, search_params[i].name) == 0)
+        {
+            if (value < search_params[i].min)
+                value = search_params[i].min;
+            if (value > search_params[i].max)
+                value = search_params[i].max;
+            *search_params[i].value = value;
+            return true;
+        }
     }
-    if (depth >= max_depth)
+    return false;
+}
+
+// the parameters as uci spin options, with the current values as defaults
+void print_search_params()
+{
+    for (size_t i = 0; i < sizeof(search_params) / sizeof(search_params[0]); i++)
     {
-        // depth extension if in check (+14.0 +/- 3.4 elo)
-        if (!(is_king_in_check(board_history->board_s) && depth-max_depth < 8))
+        printf("option name %s type spin default %d min %d max %d\n", search_params[i].name, *search_params[i].value, search_params[i].min, search_params[i].max);
+    }
+    fflush(stdout);
+}
+
+// the search runs on its own thread, the uci thread talks to it through these two flags
+static atomic_bool search_stop;
+static atomic_bool search_pondering;
+
+// to call before starting the search thread, so that an early stop is not lost
+void prepare_search(bool ponder)
+{
+    atomic_store(&search_pondering, ponder);
+    atomic_store(&search_stop, false);
+}
+
+void stop_search()
+{
+    atomic_store(&search_pondering, false);
+    atomic_store(&search_stop, true);
+}
+
+// the opponent played the expected move, the ponder search becomes a normal one
+void ponderhit()
+{
+    atomic_store(&search_pondering, false);
+}
+
+// called at the entry of every node, of the main search and of the quiescence search
+// only the main thread looks at the clock and the node count, the helpers stop when it raises the flag
+// a node limit is checked at each node, the clock once every TIME_CHECK_INTERVAL nodes, neither before the first iteration is done
+static bool search_stopped(SearchContext *ctx)
+{
+    if (atomic_load_explicit(ctx->stop, memory_order_relaxed))
+    {
+        return true;
+    }
+    if (ctx->thread_id != 0 || ctx->max_depth == 1)
+    {
+        return false;
+    }
+    if (ctx->tm->max_nodes > 0 && ctx->nodes + ctx->qnodes >= ctx->tm->max_nodes && !is_pondering(ctx->tm))
+    {
+        atomic_store(ctx->stop, true);
+        return true;
+    }
+    if (--ctx->time_check_countdown > 0)
+    {
+        return false;
+    }
+    ctx->time_check_countdown = TIME_CHECK_INTERVAL;
+    if (time_is_up(ctx->tm, ctx->nodes + ctx->qnodes))
+    {
+        atomic_store(ctx->stop, true);
+        return true;
+    }
+    return false;
+}
+
+// static eval for the player to move
+// with a network loaded, the accumulators of the plies above that were never evaluated are brought up to date
+// from the last computed one, so that the moves cut before any leaf don't cost an update
+static int evaluate(SearchContext *ctx, int depth)
+{
+    BoardState *board_s = &ctx->board;
+    if (!nnue_enabled())
+    {
+        int score = eval(board_s, &ctx->pawn_table);
+        return board_s->player == WHITE ? score : -score;
+    }
+    int ply = depth;
+    while (ply > 0 && !ctx->stack[ply].accumulator.computed)
+    {
+        ply--;
+    }
+    for (ply++; ply <= depth; ply++)
+    {
+        // a null move changes no feature
+        if (is_empty_move(ctx->stack[ply - 1].undo.move))
+            ctx->stack[ply].accumulator = ctx->stack[ply - 1].accumulator;
+        else
+            nnue_update(&ctx->stack[ply].accumulator, &ctx->stack[ply - 1].accumulator, &ctx->stack[ply - 1].undo);
+    }
+#ifdef DEBUG
+    NnueAccumulator reference;
+    nnue_refresh(&reference, board_s);
+    if (memcmp(reference.values, ctx->stack[depth].accumulator.values, sizeof(reference.values)) != 0)
+    {
+        fprintf(stderr, "incremental accumulator differs from the refresh at ply %d\n", depth);
+    }
+#endif
+    int score = nnue_evaluate(&ctx->stack[depth].accumulator, board_s->player);
+    return board_s->player == WHITE ? score : -score;
+}
+
+// plies taken off a late quiet move, by depth left and by number of moves searched before it
+static int lmr_reductions[64][64];
+static pthread_once_t lmr_once = PTHREAD_ONCE_INIT;
+
+static void init_lmr_reductions()
+{
+    for (int d = 1; d < 64; d++)
+    {
+        for (int m = 1; m < 64; m++)
         {
-            result.score = alpha_beta_score(board_history, color, is_max);
-            // store_transposition_table_entry(table, board_history->board_s->hash, result.score, 0, empty_move(), EXACT);
-            return result;
+            lmr_reductions[d][m] = (int)(LMR_BASE + log(d) * log(m) / LMR_DIVISOR);
         }
     }
-    MoveList *move_list = possible_moves_bb(board_history->board_s);
-    if (prio_move.init_co.x != -1)
+}
+
+static bool is_mate_score(int score)
+{
+    return abs(score) >= MAX_SCORE - MAX_SEARCH_PLY;
+}
+
+// a piece besides the pawns and the king, without it passing may be the best move
+static bool has_non_pawn_material(BoardState *board_s)
+{
+    Bitboard *pieces = board_s->all_pieces_bb[board_s->player];
+    return (pieces[KNIGHT] | pieces[BISHOP] | pieces[ROOK] | pieces[QUEEN]) != 0;
+}
+
+// resolve the captures and promotions left at the horizon so that the leaves are quiet positions
+// negamax form: alpha, beta and the returned score are from the point of view of the player to move
+// the player to move can stand pat (keep the static eval) instead of capturing
+// check evasions are not searched here: the main search already extends checks,
+// and trying every evasion below the horizon made the quiescence tree explode
+int quiescence(SearchContext *ctx, int alpha, int beta, int depth)
+{
+    BoardState *board_s = &ctx->board;
+    ctx->pv_length[depth] = depth;
+    if (search_stopped(ctx))
+    {
+        return 0;
+    }
+    int best_score = evaluate(ctx, depth);
+    if (best_score >= beta || depth >= MAX_SEARCH_PLY - 1)
+    {
+        return best_score;
+    }
+    if (best_score > alpha)
     {
-        move_list->moves[move_list->size] = prio_move;
-        move_list->size++;
+        alpha = best_score;
     }
-    if (move_list->size == 0)
+    SearchStack *ss = &ctx->stack[depth];
+    MovePicker picker;
+    init_move_picker(&picker, ctx, depth, &ss->move_list, empty_move(), true);
+    Move move;
+    while (!is_empty_move(move = next_move(&picker)))
     {
-        if (is_king_in_check(board_history->board_s))
+        make_move(board_s, move, &ss->undo);
+        ctx->stack[depth + 1].accumulator.computed = false;
+        ctx->qnodes++;
+        int score = -quiescence(ctx, -beta, -alpha, depth + 1);
+        unmake_move(board_s, &ss->undo);
+        if (atomic_load_explicit(ctx->stop, memory_order_relaxed))
+        {
+            return 0;
+        }
+        if (score > best_score)
+        {
+            best_score = score;
+        }
+        if (score > alpha)
         {
-            result.score = is_max ? -(MAX_SCORE - depth) : (MAX_SCORE - depth);
-            free(move_list);
-            return result;
+            alpha = score;
         }
-        result.score = 0;
-        free(move_list);
-        return result;
+        if (alpha >= beta)
+        {
+            break;
+        }
+    }
+    return best_score;
+}
+
+// mate scores are kept in the table from the node that stores them, not from the root,
+// so that a mate found through a transposition gets the right distance
+static int score_to_tt(int score, int depth)
+{
+    if (score >= MAX_SCORE - MAX_SEARCH_PLY)
+        return score + depth;
+    if (score <= -MAX_SCORE + MAX_SEARCH_PLY)
+        return score - depth;
+    return score;
+}
+
+static int score_from_tt(int score, int depth)
+{
+    if (score >= MAX_SCORE - MAX_SEARCH_PLY)
+        return score - depth;
+    if (score <= -MAX_SCORE + MAX_SEARCH_PLY)
+        return score + depth;
+    return score;
+}
+
+// the principal variation of the child followed by move becomes the one of the node
+static void update_pv(SearchContext *ctx, int depth, Move move)
+{
+    ctx->pv[depth][depth] = move;
+    for (int ply = depth + 1; ply < ctx->pv_length[depth + 1]; ply++)
+    {
+        ctx->pv[depth][ply] = ctx->pv[depth + 1][ply];
+    }
+    ctx->pv_length[depth] = ctx->pv_length[depth + 1] > depth + 1 ? ctx->pv_length[depth + 1] : depth + 1;
+}
+
+// principal variation search, in negamax form like the quiescence search
+
+// ctx holds the transposition table, the time limits, the node counter, the maximum depth of the search,
+// the board of the thread (moved in place with make_move/unmake_move), the per ply search stack and the pv table
+// alpha and beta are the window of the player to move, the returned score is from its point of view
+// depth is the ply from the root
+// depth_to_go is what is left of the depth of the iteration at this node, the quiescence search takes over at 0
+// the first move is searched with the whole window, the others with a null window first, then again
+// with the whole window if they beat alpha: only a node with beta - alpha > 1 can be on the principal variation
+// the pv of the node is left in ctx->pv[depth], the root one is the best line of the iteration
+// a stopped search returns 0, the caller must not use it
+
+static int alphabeta(SearchContext *ctx, int alpha, int beta, int depth, int depth_to_go)
+{
+    ctx->nodes++;
+    ctx->pv_length[depth] = depth;
+    if (search_stopped(ctx))
+    {
+        return 0;
     }
-    BoardState *new_board_s = malloc(sizeof(BoardState));
-    PositionList *new_board_history = malloc(sizeof(PositionList));
-    if (new_board_s == NULL || new_board_history == NULL)
+    TranspoTable *table = ctx->tt;
+    BoardState *board_s = &ctx->board;
+    bool pv_node = beta - alpha > 1;
+    ctx->keys[ctx->root_key + depth] = board_s->hash;
+    if (depth > 0 && is_repetition(ctx, depth))
     {
-        result.score = 0;
-        result.move = empty_move();
-        free(move_list);
-        return result;
+        return 0;
     }
-    new_board_history->tail = board_history;
-    Color next_color = color ^ 1;
-    double time_taken;
-    // Check transposition table
-    int depth_to_go = max_depth - depth;
-    if (depth_to_go < 0)
+    bool in_check = is_king_in_check(board_s);
+    if (depth_to_go <= 0 || depth >= MAX_SEARCH_PLY - 1)
     {
+        // depth extension if in check (+14.0 +/- 3.4 elo)
+        if (!(in_check && depth - ctx->max_depth < 8) || depth >= MAX_SEARCH_PLY - 1)
+        {
+            return quiescence(ctx, alpha, beta, depth);
+        }
         depth_to_go = 0;
     }
+    SearchStack *ss = &ctx->stack[depth];
+    // Check transposition table before generating anything
     Move tt_move = empty_move();
-    if (tt_lookup(table, board_history->board_s->hash, depth_to_go, alpha, beta, &result.score, &tt_move))
+    bool tt_found;
+    int tt_score;
+    bool tt_cutoff = tt_lookup(table, board_s->hash, depth_to_go, alpha, beta, &tt_score, &tt_move, &tt_found);
+    ctx->tt_probes++;
+    ctx->tt_hits += tt_found;
+    // no cutoff on the principal variation, it would end there
+    // an entry with a move is only trusted if the move can be played here (16 bits of key can collide)
+    if (tt_cutoff && !pv_node && (is_empty_move(tt_move) || is_legal_move(board_s, tt_move)))
     {
-        // Only use TT move if it's valid (to prevent hits on same hash entries with different positions)
-        if (is_in_move_list(move_list, tt_move))
+        ctx->tt_cutoffs++;
+        return score_from_tt(tt_score, depth);
+    }
+    // the best move of the previous iteration is tried first at the root, whatever the table kept
+    if (depth == 0 && !is_empty_move(ctx->root_move))
+    {
+        tt_move = ctx->root_move;
+    }
+    // the pruning below relies on the static eval, of no use in check, and must not hide mates:
+    // no node is cut on a mate bound and no move is skipped before one that avoids being mated is found
+    bool prunable = depth > 0 && !in_check;
+    int static_eval = prunable ? evaluate(ctx, depth) : 0;
+    // reverse futility: near the leaves, a static eval beating beta by a margin growing with the depth left
+    // is trusted to hold
+    if (prunable && !pv_node && depth_to_go <= rfp_max_depth && !is_mate_score(beta) && static_eval - rfp_margin * depth_to_go >= beta)
+    {
+        ctx->rfp_prunes++;
+        return static_eval - rfp_margin * depth_to_go;
+    }
+    // razoring: far below alpha just above the leaves, only a capture could save the node, the quiescence
+    // search decides and the node is cut if it confirms
+    if (prunable && !pv_node && depth_to_go <= razor_max_depth && !is_mate_score(alpha) && static_eval + razor_margin * depth_to_go <= alpha)
+    {
+        int score = quiescence(ctx, alpha, alpha + 1, depth);
+        if (atomic_load_explicit(ctx->stop, memory_order_relaxed))
+        {
+            return 0;
+        }
+        if (score <= alpha)
         {
-            result.move = tt_move;
-            // mate normalization
-            if (result.score > MAX_SCORE - 100)
+            ctx->razor_prunes++;
+            return score;
+        }
+    }
+    // null move pruning: the player to move passes, if a reduced search still fails high for it the node is cut
+    // not right after another null move, and not without pieces besides the pawns and the king, where passing may
+    // be the best move (zugzwang)
+    if (prunable && !pv_node && depth_to_go >= NULL_MOVE_MIN_DEPTH && !is_mate_score(beta) && static_eval >= beta &&
+        !is_empty_move(ctx->stack[depth - 1].undo.move) && has_non_pawn_material(board_s))
+    {
+        int reduction = NULL_MOVE_REDUCTION + depth_to_go / NULL_MOVE_DEPTH_DIVISOR;
+        make_null_move(board_s, &ss->undo);
+        ctx->stack[depth + 1].accumulator.computed = false;
+        int score = -alphabeta(ctx, -beta, -beta + 1, depth + 1, depth_to_go - 1 - reduction);
+        unmake_null_move(board_s, &ss->undo);
+        if (atomic_load_explicit(ctx->stop, memory_order_relaxed))
+        {
+            return 0;
+        }
+        if (score >= beta)
+        {
+            ctx->null_move_prunes++;
+            // not a proven mate, the moves were not searched
+            return beta;
+        }
+    }
+
+    MovePicker picker;
+    init_move_picker(&picker, ctx, depth, &ss->move_list, tt_move, false);
+    int original_alpha = alpha;
+    int best_score = -MAX_SCORE;
+    Move best_move = empty_move();
+    int moves_searched = 0;
+    Move quiets_tried[MAX_MOVES];
+    int nb_quiets_tried = 0;
+    Move new_move;
+    while (!is_empty_move(new_move = next_move(&picker)))
+    {
+        bool quiet = is_quiet_move(board_s, new_move);
+        // the captures the picker kept for last lose material, near the leaves the ones losing too much are skipped
+        if (prunable && picker.stage == STAGE_BAD_CAPTURES && moves_searched > 0 && best_score > -MAX_SCORE + MAX_SEARCH_PLY &&
+            depth_to_go <= see_prune_max_depth && see(board_s, new_move) < -see_prune_margin * depth_to_go)
+        {
+            ctx->see_prunes++;
+            continue;
+        }
+        make_move(board_s, new_move, &ss->undo);
+        ctx->stack[depth + 1].accumulator.computed = false;
+        bool gives_check = is_king_in_check(board_s);
+        // quiet moves that don't give check are skipped near the leaves once a move has been searched
+        if (prunable && quiet && moves_searched > 0 && !gives_check && best_score > -MAX_SCORE + MAX_SEARCH_PLY)
+        {
+            // late move pruning: the ordering puts the good quiet moves first, past a count growing with the depth
+            // left the others are not searched at all
+            if (depth_to_go <= lmp_max_depth && moves_searched >= lmp_base + depth_to_go * depth_to_go)
             {
-                result.score -= depth;
+                ctx->lmp_prunes++;
+                unmake_move(board_s, &ss->undo);
+                continue;
             }
-            else if (result.score < -MAX_SCORE + 100)
+            // futility pruning: the static eval is too far below alpha for a quiet move to reach it
+            if (depth_to_go <= futility_max_depth && static_eval + futility_base + futility_margin * depth_to_go <= alpha)
             {
-                result.score += depth;
+                ctx->futility_prunes++;
+                unmake_move(board_s, &ss->undo);
+                continue;
             }
-            free(move_list);
-            free(new_board_s);
-            free(new_board_history);
-            return result;
         }
-    }
-    Flag tt_flag = EXACT;
-    if (is_max)
-    {
-        result.score = -MAX_SCORE;
-        for (int i = move_list->size - 1; i >= 0; i--)
+        int score;
+        if (moves_searched == 0)
+        {
+            score = -alphabeta(ctx, -beta, -alpha, depth + 1, depth_to_go - 1);
+        }
+        else
         {
-            time_taken = ((double)(clock() - start_clk)) / CLOCKS_PER_SEC;
-            if (time_taken > max_time)
+            // late move reductions: the quiet moves ordered late are searched shallower first
+            int reduction = 0;
+            if (depth_to_go >= LMR_MIN_DEPTH && moves_searched >= LMR_MIN_MOVES && quiet && !in_check && !gives_check &&
+                new_move != picker.killers[0] && new_move != picker.killers[1])
             {
-                // si on n'a pas fini d'évaluer nos coups, on prend le mieux qu'on a trouvé
-                if (depth == 0)
-                    {
-                        fprintf(stderr, "time exceeded the limit, time taken: %f\n", time_taken);
-                    }
-                break;
+                reduction = lmr_reductions[depth_to_go < 64 ? depth_to_go : 63][moves_searched < 64 ? moves_searched : 63];
+                if (reduction > depth_to_go - 2)
+                {
+                    reduction = depth_to_go - 2;
+                }
             }
-            Move new_move = move_list->moves[i];
-            *new_board_s = *board_history->board_s;
-            new_board_s = move_piece(new_board_s, new_move);
-            new_board_history->board_s = new_board_s;
-            int new_score;
-            MoveScore new_move_score = alphabeta(alpha, beta, depth + 1, max_depth, table, new_board_history, next_color, new_move, 0, 1, nodes, start_clk, max_time, empty_move());
-            new_score = new_move_score.score;
-            if (new_score > result.score)
+            // null window: the move only has to be proven no better than alpha
+            score = -alphabeta(ctx, -alpha - 1, -alpha, depth + 1, depth_to_go - 1 - reduction);
+            if (score > alpha && reduction > 0)
             {
-                result.move = new_move;
-                result.score = new_score;
+                score = -alphabeta(ctx, -alpha - 1, -alpha, depth + 1, depth_to_go - 1);
             }
-            if (result.score > alpha)
+            if (score > alpha && score < beta)
             {
-                alpha = result.score;
+                score = -alphabeta(ctx, -beta, -alpha, depth + 1, depth_to_go - 1);
             }
-            if (alpha >= beta)
+        }
+        unmake_move(board_s, &ss->undo);
+        // an interrupted search gives unreliable scores, don't let them reach the other threads or the ordering tables
+        if (atomic_load_explicit(ctx->stop, memory_order_relaxed))
+        {
+            if (depth == 0 && ctx->thread_id == 0 && ctx->tm->timed)
             {
-                tt_flag = UPPERBOUND;
-                break;
+                fprintf(stderr, "time exceeded the limit, time taken: %f\n", get_time() - ctx->tm->start_time);
+            }
+            return 0;
+        }
+        moves_searched++;
+        if (score > best_score)
+        {
+            best_score = score;
+            best_move = new_move;
+            if (score > alpha)
+            {
+                alpha = score;
+                update_pv(ctx, depth, new_move);
             }
         }
+        if (alpha >= beta)
+        {
+            break;
+        }
+        if (quiet && nb_quiets_tried < MAX_MOVES)
+        {
+            quiets_tried[nb_quiets_tried++] = new_move;
+        }
+    }
+    if (moves_searched == 0)
+    {
+        // no legal move: checkmate or stalemate
+        return in_check ? -(MAX_SCORE - depth) : 0;
+    }
+    Flag tt_flag = best_score >= beta ? LOWERBOUND : best_score > original_alpha ? EXACT : UPPERBOUND;
+    if (tt_flag == LOWERBOUND)
+    {
+        ctx->cutoffs++;
+        if (moves_searched == 1)
+        {
+            ctx->first_move_cutoffs++;
+        }
+        // the picker generates nothing before the table move has been searched
+        if (picker.stage == STAGE_INIT_CAPTURES)
+        {
+            ctx->tt_move_cutoffs++;
+        }
+        if (is_quiet_move(board_s, best_move))
+        {
+            update_quiet_stats(ctx, depth, depth_to_go, best_move, quiets_tried, nb_quiets_tried);
+        }
+    }
+    // below alpha every move is only an upper bound, none of them is worth keeping as the best
+    store_transposition_table_entry(table, board_s->hash, score_to_tt(best_score, depth), depth_to_go,
+                                    tt_flag == UPPERBOUND ? empty_move() : best_move, tt_flag);
+    return best_score;
+}
+
+// one iteration from the root, in a window around the score of the previous one
+// the window is widened on the side that failed until the score lands inside
+static int aspiration_search(SearchContext *ctx, int depth, int previous_score)
+{
+    int delta = ASPIRATION_WINDOW;
+    int alpha = -MAX_SCORE;
+    int beta = MAX_SCORE;
+    if (depth >= ASPIRATION_MIN_DEPTH && !is_mate_score(previous_score))
+    {
+        alpha = previous_score - delta > -MAX_SCORE ? previous_score - delta : -MAX_SCORE;
+        beta = previous_score + delta < MAX_SCORE ? previous_score + delta : MAX_SCORE;
+    }
+    while (true)
+    {
+        int score = alphabeta(ctx, alpha, beta, 0, depth);
+        if (atomic_load(ctx->stop))
+        {
+            return score;
+        }
+        if (score <= alpha && alpha > -MAX_SCORE)
+        {
+            // fail low: the best move may not be one, beta comes closer so that the research is cheaper
+            beta = (alpha + beta) / 2;
+            alpha = score - delta > -MAX_SCORE ? score - delta : -MAX_SCORE;
+        }
+        else if (score >= beta && beta < MAX_SCORE)
+        {
+            beta = score + delta < MAX_SCORE ? score + delta : MAX_SCORE;
+        }
+        else
+        {
+            return score;
+        }
+        ctx->aspiration_researches++;
+        delta += delta / 2;
+    }
+}
+
+// one context per thread, allocated on first use and reused by every search
+static SearchContext *thread_contexts[MAX_THREADS];
+
+// a context with empty tables, owned by the caller (the self-play workers have one each)
+SearchContext *new_search_context()
+{
+    SearchContext *ctx = malloc(sizeof(SearchContext));
+    if (ctx != NULL)
+    {
+        clear_ordering_tables(ctx);
+        clear_pawn_table(&ctx->pawn_table);
+    }
+    return ctx;
+}
+
+static SearchContext *get_thread_context(int thread_id)
+{
+    if (thread_contexts[thread_id] == NULL)
+    {
+        thread_contexts[thread_id] = new_search_context();
+    }
+    return thread_contexts[thread_id];
+}
+
+// everything a context needs before a search of the head of board_history
+static void setup_context(SearchContext *ctx, TranspoTable *tt, atomic_bool *stop, PositionList *board_history, TimeManager *tm, int max_depth, int thread_id)
+{
+    ctx->tt = tt;
+    ctx->stop = stop;
+    ctx->game_history = board_history;
+    ctx->board = *board_history->board_s;
+    if (nnue_enabled())
+    {
+        nnue_refresh(&ctx->stack[0].accumulator, &ctx->board);
+    }
+    load_game_keys(ctx);
+    ctx->tm = tm;
+    ctx->time_check_countdown = TIME_CHECK_INTERVAL;
+    ctx->max_depth = max_depth;
+    ctx->thread_id = thread_id;
+    pthread_once(&lmr_once, init_lmr_reductions);
+    ctx->nodes = 0;
+    ctx->qnodes = 0;
+    ctx->tt_probes = 0;
+    ctx->tt_hits = 0;
+    ctx->tt_cutoffs = 0;
+    ctx->tt_move_cutoffs = 0;
+    ctx->cutoffs = 0;
+    ctx->first_move_cutoffs = 0;
+    ctx->null_move_prunes = 0;
+    ctx->rfp_prunes = 0;
+    ctx->razor_prunes = 0;
+    ctx->futility_prunes = 0;
+    ctx->lmp_prunes = 0;
+    ctx->see_prunes = 0;
+    ctx->aspiration_researches = 0;
+    ctx->pv_length[0] = 0;
+    ctx->root_move = empty_move();
+    ctx->pawn_table.probes = 0;
+    ctx->pawn_table.hits = 0;
+    age_ordering_tables(ctx);
+}
+
+// ucinewgame: the ordering tables of every thread start over
+void clear_search_tables()
+{
+    for (int t = 0; t < MAX_THREADS; t++)
+    {
+        if (thread_contexts[t] != NULL)
+        {
+            clear_ordering_tables(thread_contexts[t]);
+        }
+    }
+}
+
+// UCI info line of the main thread after each iteration
+static void print_info(SearchContext *ctx, int depth, int score, double total_time)
+{
+    uint64_t nodes = ctx->nodes + ctx->qnodes;
+    printf("info depth %d score ", depth);
+    if (abs(score) >= MAX_SCORE - MAX_SEARCH_PLY)
+    {
+        int plies = MAX_SCORE - abs(score);
+        printf("mate %d", score > 0 ? (plies + 1) / 2 : -(plies + 1) / 2);
     }
     else
     {
-        result.score = MAX_SCORE;
-        for (int i = move_list->size - 1; i >= 0; i--)
+        printf("cp %d", score);
+    }
+    printf(" nodes %llu nps %llu time %d hashfull %d pv", (unsigned long long)nodes, (unsigned long long)(total_time > 0 ? nodes / total_time : 0), (int)(total_time * 1000), hashfull(ctx->tt));
+    for (int ply = 0; ply < ctx->pv_length[0]; ply++)
+    {
+        char move_str[6];
+        move_to_uci(ctx->pv[0][ply], move_str);
+        printf(" %s", move_str);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+// lazy SMP helper: same root as the main thread, odd helpers search one ply deeper
+// so that the threads spread over different depths and fill the shared table for each other
+static void *helper_search(void *arg)
+{
+    SearchContext *ctx = (SearchContext *)arg;
+    int max_depth = ctx->max_depth;
+    int score = 0;
+    for (int i = 1; i <= max_depth; i++)
+    {
+        ctx->max_depth = i + (ctx->thread_id & 1);
+        if (ctx->max_depth > max_depth)
         {
-            time_taken = ((double)(clock() - start_clk)) / CLOCKS_PER_SEC;
-            if (time_taken > max_time)
-            {
-                // si on n'a pas fini d'évaler les coups de l'ennemi, on considère qu'il est dans une position gagnante
-                result.score = -MAX_SCORE;
-                break;
-            }
-            Move new_move = move_list->moves[i];
-            *new_board_s = *board_history->board_s;
-            new_board_s = move_piece(new_board_s, new_move);
-            new_board_history->board_s = new_board_s;
-            int new_score;
-            MoveScore new_move_score = alphabeta(alpha, beta, depth + 1, max_depth, table, new_board_history, next_color, new_move, 1, 0, nodes, start_clk, max_time, empty_move());
-            new_score = new_move_score.score;
-            if (new_score < result.score)
-            {
-                result.score = new_score;
-                result.move = new_move;
-            }
-            if (result.score < beta)
-            {
-                beta = result.score;
-            }
-            if (alpha >= beta)
-            {
-                tt_flag = LOWERBOUND;
-                break;
-            }
+            ctx->max_depth = max_depth;
+        }
+        score = aspiration_search(ctx, ctx->max_depth, score);
+        if (atomic_load(ctx->stop))
+        {
+            break;
         }
+        ctx->root_move = ctx->pv_length[0] > 0 ? ctx->pv[0][0] : empty_move();
     }
-    free(move_list);
-    free(new_board_s);
-    free(new_board_history);
-    store_transposition_table_entry(table, board_history->board_s->hash, result.score, depth_to_go, result.move, tt_flag);
-    return result;
+    return NULL;
 }
 
 // do an alpha beta iterative deepening search
-// board_s is the current board state
-// color is the color of the player to move
-// max_depth is the maximum depth of the search
+// board_history is the game, its head is the current board state
+// limits are the ones of the go command: clock, movetime, depth, nodes or mate
 // return the best move found
 
-Move iterative_deepening(TranspoTable *tt, PositionList *board_history, Color color, int max_depth, double max_time)
+Move iterative_deepening(TranspoTable *tt, PositionList *board_history, SearchLimits *limits)
 {
-    clock_t glob_start = clock();
+    TimeManager tm;
+    Color color = board_history->board_s->player;
+    init_time_manager(&tm, limits, color, &search_pondering);
+    double glob_start = tm.start_time;
+    int max_depth = limits->depth > 0 ? limits->depth : MAX_SEARCH_PLY / 2;
+    if (limits->mate > 0 && limits->depth <= 0)
+    {
+        max_depth = 2 * limits->mate;
+    }
+    double last_iteration_time = 0;
+    double previous_iteration_time = 0;
     Move move = empty_move();
-    MoveScore new_move_score;
-    clock_t start_iter, end_iter;
+    double start_iter, end_iter;
     double cpu_time_used;
-    int nodes = 0;
-    int score;
+    uint64_t nodes = 0;
+    uint64_t qnodes = 0;
+    int score = 0;
     double nps;
+
+    atomic_bool *stop = &search_stop;
+    SearchContext *contexts[MAX_THREADS] = {0};
+    for (int t = 0; t < search_threads; t++)
+    {
+        contexts[t] = get_thread_context(t);
+        if (contexts[t] == NULL)
+        {
+            fprintf(stderr, "could not allocate search thread %d\n", t);
+            if (t == 0)
+            {
+                return empty_move();
+            }
+            break;
+        }
+        setup_context(contexts[t], tt, stop, board_history, &tm, max_depth, t);
+    }
+    SearchContext *ctx = contexts[0];
+    new_search_generation(tt);
+
+    // helpers share the table and the stop flag with the main thread, they never report a move
+    pthread_t helper_ids[MAX_THREADS];
+    int nb_helpers = 0;
+    for (int t = 1; t < search_threads && contexts[t] != NULL; t++)
+    {
+        if (pthread_create(&helper_ids[nb_helpers], NULL, helper_search, contexts[t]) != 0)
+        {
+            fprintf(stderr, "could not start search thread %d\n", t);
+            break;
+        }
+        nb_helpers++;
+    }
+
     for (int i = 1; i <= max_depth; i++)
     {
-        nodes = 0;
-        start_iter = clock();
-        new_move_score = alphabeta(-MAX_SCORE, MAX_SCORE, 0, i, tt, board_history, color, empty_move(), 1, 0, &nodes, glob_start, max_time, move);
-        end_iter = clock();
-        cpu_time_used = ((double)(end_iter - start_iter)) / CLOCKS_PER_SEC;
-        nps = nodes / cpu_time_used;
-        if (!is_empty_move(new_move_score.move))
+        nodes = ctx->nodes;
+        qnodes = ctx->qnodes;
+        ctx->max_depth = i;
+        start_iter = get_time();
+        int iteration_score = aspiration_search(ctx, i, score);
+        end_iter = get_time();
+        nodes = ctx->nodes - nodes;
+        qnodes = ctx->qnodes - qnodes;
+        cpu_time_used = end_iter - start_iter;
+        nps = (nodes + qnodes) / cpu_time_used;
+        // a stopped iteration still gives its best move if one was fully searched, the previous best comes first
+        if (ctx->pv_length[0] > 0)
+        {
+            move = ctx->pv[0][0];
+            ctx->root_move = move;
+        }
+        double total_time = get_time() - glob_start;
+        char move_str[6];
+        move_to_uci(move, move_str);
+        if (!atomic_load(stop))
         {
-            move = new_move_score.move;
+            score = iteration_score;
+            print_info(ctx, i, score, total_time);
         }
-        double total_time = ((double)(clock() - glob_start)) / CLOCKS_PER_SEC;
-        fprintf(stderr, "depth: %d, move: %c%c -> %c%c, score: %d, time taken: %f, nodes checked: %d, nps: %f\n", i, 'a' + move.init_co.y, '1' + move.init_co.x, 'a' + move.dest_co.y, '1' + move.dest_co.x, new_move_score.score, cpu_time_used, nodes, nps);
-        if (total_time > max_time && new_move_score.score < -1000)
-            fprintf(stderr, "no move was completed on last iteration, taking previous score as reference\n");
         else
-            score = new_move_score.score;
+        {
+            fprintf(stderr, "last iteration stopped, taking previous score as reference\n");
+        }
+        fprintf(stderr, "depth: %d, move: %s, score: %d, time taken: %f, nodes checked: %llu, qnodes: %llu, nps: %f, time to depth: %f\n", i, move_str, score, cpu_time_used, (unsigned long long)nodes, (unsigned long long)qnodes, nps, total_time);
         if (abs(score) >= MAX_SCORE - 50)
         {
             fprintf(stderr, "a mate was found\n");
@@ -249,15 +836,116 @@ Move iterative_deepening(TranspoTable *tt, PositionList *board_history, Color co
                 break;
             }
         }
-        // if (score < -1000 && (total_time > max_time || i >= max_depth))
+        previous_iteration_time = last_iteration_time;
+        last_iteration_time = cpu_time_used;
+        // if (score < -1000 && (atomic_load(stop) || i >= max_depth))
         // {
         //     fprintf(stderr, "surrendering\n");
         //     return empty_move();
         // }
-        if (total_time > max_time)
+        if (atomic_load(stop) || !can_start_iteration(&tm, last_iteration_time, previous_iteration_time))
+        {
+            break;
+        }
+    }
+
+    // bestmove is only expected after stop, or after ponderhit when pondering
+    while (!atomic_load(stop) && (limits->infinite || is_pondering(&tm)))
+    {
+        struct timespec pause = {0, 1000000};
+        nanosleep(&pause, NULL);
+    }
+    atomic_store(stop, true);
+    if (is_empty_move(move))
+    {
+        // stopped before the first iteration could finish, any legal move beats none
+        MoveList legal_moves;
+        possible_moves_bb(board_history->board_s, &legal_moves);
+        if (legal_moves.size > 0)
+            move = legal_moves.moves[0];
+    }
+    uint64_t total_nodes = ctx->nodes;
+    uint64_t total_qnodes = ctx->qnodes;
+    uint64_t cutoffs = ctx->cutoffs;
+    uint64_t first_move_cutoffs = ctx->first_move_cutoffs;
+    uint64_t tt_probes = ctx->tt_probes;
+    uint64_t tt_hits = ctx->tt_hits;
+    uint64_t tt_cutoffs = ctx->tt_cutoffs;
+    uint64_t tt_move_cutoffs = ctx->tt_move_cutoffs;
+    uint64_t null_move_prunes = ctx->null_move_prunes;
+    uint64_t rfp_prunes = ctx->rfp_prunes;
+    uint64_t razor_prunes = ctx->razor_prunes;
+    uint64_t futility_prunes = ctx->futility_prunes;
+    uint64_t lmp_prunes = ctx->lmp_prunes;
+    uint64_t see_prunes = ctx->see_prunes;
+    uint64_t aspiration_researches = ctx->aspiration_researches;
+    uint64_t pawn_probes = ctx->pawn_table.probes;
+    uint64_t pawn_hits = ctx->pawn_table.hits;
+    for (int t = 0; t < nb_helpers; t++)
+    {
+        pthread_join(helper_ids[t], NULL);
+        total_nodes += contexts[t + 1]->nodes;
+        total_qnodes += contexts[t + 1]->qnodes;
+        cutoffs += contexts[t + 1]->cutoffs;
+        first_move_cutoffs += contexts[t + 1]->first_move_cutoffs;
+        tt_probes += contexts[t + 1]->tt_probes;
+        tt_hits += contexts[t + 1]->tt_hits;
+        tt_cutoffs += contexts[t + 1]->tt_cutoffs;
+        tt_move_cutoffs += contexts[t + 1]->tt_move_cutoffs;
+        null_move_prunes += contexts[t + 1]->null_move_prunes;
+        rfp_prunes += contexts[t + 1]->rfp_prunes;
+        razor_prunes += contexts[t + 1]->razor_prunes;
+        futility_prunes += contexts[t + 1]->futility_prunes;
+        lmp_prunes += contexts[t + 1]->lmp_prunes;
+        see_prunes += contexts[t + 1]->see_prunes;
+        aspiration_researches += contexts[t + 1]->aspiration_researches;
+        pawn_probes += contexts[t + 1]->pawn_table.probes;
+        pawn_hits += contexts[t + 1]->pawn_table.hits;
+    }
+    double total_time = get_time() - glob_start;
+    fprintf(stderr, "threads: %d, total nodes: %llu, total qnodes: %llu, total time: %f, nps: %f\n", nb_helpers + 1, (unsigned long long)total_nodes, (unsigned long long)total_qnodes, total_time, (total_nodes + total_qnodes) / total_time);
+    // a well ordered search finds its cutoff with the first move most of the time
+    fprintf(stderr, "cutoffs: %llu, first move cutoffs: %.1f%%\n", (unsigned long long)cutoffs, cutoffs ? 100.0 * first_move_cutoffs / cutoffs : 0.0);
+    fprintf(stderr, "tt probes: %llu, tt hits: %.1f%%\n", (unsigned long long)tt_probes, tt_probes ? 100.0 * tt_hits / tt_probes : 0.0);
+    // nodes left without any move generation, by the table entry or by the table move
+    fprintf(stderr, "movegen calls saved: %llu (tt cutoffs: %llu, tt move cutoffs: %llu), %.1f%% of the nodes\n", (unsigned long long)(tt_cutoffs + tt_move_cutoffs),
+            (unsigned long long)tt_cutoffs, (unsigned long long)tt_move_cutoffs, total_nodes ? 100.0 * (tt_cutoffs + tt_move_cutoffs) / total_nodes : 0.0);
+    fprintf(stderr, "nodes pruned: null move %llu, reverse futility %llu, razoring %llu; moves pruned: futility %llu, late moves %llu, see %llu\n", (unsigned long long)null_move_prunes,
+            (unsigned long long)rfp_prunes, (unsigned long long)razor_prunes, (unsigned long long)futility_prunes, (unsigned long long)lmp_prunes, (unsigned long long)see_prunes);
+    fprintf(stderr, "aspiration researches: %llu\n", (unsigned long long)aspiration_researches);
+    fprintf(stderr, "pawn table probes: %llu, pawn table hits: %.1f%%\n", (unsigned long long)pawn_probes, pawn_probes ? 100.0 * pawn_hits / pawn_probes : 0.0);
+    return move;
+}
+
+// single threaded search of the head of board_history on a caller owned context and table, without any output
+// the self-play games run many of these at once, limited by nodes or depth
+// score gets the score of the last completed iteration, for the player to move
+Move search_position(SearchContext *ctx, TranspoTable *tt, PositionList *board_history, SearchLimits *limits, int *score)
+{
+    atomic_bool stop = false;
+    atomic_bool pondering = false;
+    TimeManager tm;
+    init_time_manager(&tm, limits, board_history->board_s->player, &pondering);
+    int max_depth = limits->depth > 0 ? limits->depth : MAX_SEARCH_PLY / 2;
+    setup_context(ctx, tt, &stop, board_history, &tm, max_depth, 0);
+    new_search_generation(tt);
+    Move move = empty_move();
+    *score = 0;
+    for (int i = 1; i <= max_depth; i++)
+    {
+        ctx->max_depth = i;
+        int iteration_score = aspiration_search(ctx, i, *score);
+        if (atomic_load(&stop))
+        {
+            break;
+        }
+        move = ctx->pv_length[0] > 0 ? ctx->pv[0][0] : empty_move();
+        ctx->root_move = move;
+        *score = iteration_score;
+        if (abs(*score) >= MAX_SCORE - MAX_SEARCH_PLY || !can_start_iteration(&tm, 0, 0))
         {
             break;
         }
     }
     return move;
-}
\ No newline at end of file
+}
@@ -204,80 +204,85 @@ Bitboard get_king_pseudo_moves_nocastle(Bitboard kings, Bitboard ally)
     return king_moves & ~ally;
 }
 
-Bitboard get_king_pseudo_moves(Bitboard kings, Bitboard ally, Bitboard blockers, Bitboard threatened_squares, Color color, bool kingside_castlable, bool queenside_castlable)
+// squares attacked by pawns, pushes excluded
+Bitboard get_white_pawn_attacks(Bitboard pawns)
 {
-    Bitboard not_a_file = ~FILE_A;
-    Bitboard not_h_file = ~FILE_H;
-    Bitboard king_moves = ((kings << 8) | (kings >> 8) |
-                           ((kings << 1) & not_h_file) | ((kings >> 1) & not_a_file) |
-                           ((kings << 9) & not_h_file) | ((kings << 7) & not_a_file) |
-                           ((kings >> 9) & not_a_file) | ((kings >> 7) & not_h_file));
+    return ((pawns & ~FILE_A) << 9) | ((pawns & ~FILE_H) << 7);
+}
 
-    if (kingside_castlable)
-    {
-        Bitboard kingside_block_mask = color == WHITE ? 6 : 0x600000000000000;
-        Bitboard kingside_threatened_mask = color == WHITE ? 0xe : 0xe00000000000000;
-        if ((blockers & kingside_block_mask) == 0 && (threatened_squares & kingside_threatened_mask) == 0)
-            king_moves |= (kings >> 2);
-    }
-    if (queenside_castlable)
+Bitboard get_black_pawn_attacks(Bitboard pawns)
+{
+    return ((pawns & ~FILE_H) >> 9) | ((pawns & ~FILE_A) >> 7);
+}
+
+// squares strictly between two aligned squares, and the whole line through them (0 when they are not aligned)
+static Bitboard between_bb[64][64];
+static Bitboard line_bb[64][64];
+
+void init_bitboard_tables()
+{
+    for (int s1 = 0; s1 < 64; s1++)
     {
-        Bitboard queenside_block_mask = color == WHITE ? 0x70 : 0x7000000000000000;
-        Bitboard queenside_threatened_mask = color == WHITE ? 0x38 : 0x3800000000000000;
-        if ((blockers & queenside_block_mask) == 0 && (threatened_squares & queenside_threatened_mask) == 0)
+        for (int s2 = 0; s2 < 64; s2++)
         {
-            king_moves |= (kings << 2);
+            Bitboard b1 = 1ULL << s1;
+            Bitboard b2 = 1ULL << s2;
+            between_bb[s1][s2] = 0;
+            line_bb[s1][s2] = 0;
+            if (s1 == s2)
+                continue;
+            if (get_bishop_moves_square(0, s1) & b2)
+            {
+                line_bb[s1][s2] = (get_bishop_moves_square(0, s1) & get_bishop_moves_square(0, s2)) | b1 | b2;
+                between_bb[s1][s2] = get_bishop_moves_square(b2, s1) & get_bishop_moves_square(b1, s2);
+            }
+            else if (get_rook_moves_square(0, s1) & b2)
+            {
+                line_bb[s1][s2] = (get_rook_moves_square(0, s1) & get_rook_moves_square(0, s2)) | b1 | b2;
+                between_bb[s1][s2] = get_rook_moves_square(b2, s1) & get_rook_moves_square(b1, s2);
+            }
         }
     }
-
-    return king_moves & ~ally;
 }
 
-Bitboard get_attacks(BoardState *board_s)
+// pieces of both colors attacking square, with the given occupancy for the sliders
+Bitboard attackers_to(BoardState *board_s, int square, Bitboard occupancy)
 {
-    Color color = board_s->player;
-    Color enemy_color = color ^ 1;
-    Bitboard ally = board_s->color_bb[color];
-    Bitboard enemy = board_s->color_bb[enemy_color];
-    Bitboard blockers = ally | enemy;
     Bitboard(*all_pieces_bb)[6] = board_s->all_pieces_bb;
-    Bitboard attacks = 0;
-    if (enemy_color == WHITE)
-        attacks |= get_white_pawn_pseudo_moves(all_pieces_bb[enemy_color][PAWN], ~ally & ~enemy, ally, board_s->black_pawn_passant);
-    else
-        attacks |= get_black_pawn_pseudo_moves(all_pieces_bb[enemy_color][PAWN], ~ally & ~enemy, ally, board_s->white_pawn_passant);
-    attacks |= get_knight_pseudo_moves(all_pieces_bb[enemy_color][KNIGHT], enemy);
-    attacks |= get_rook_pseudo_moves(all_pieces_bb[enemy_color][ROOK], enemy, blockers);
-    attacks |= get_bishop_pseudo_moves(all_pieces_bb[enemy_color][BISHOP], enemy, blockers);
-    attacks |= get_queen_pseudo_moves(all_pieces_bb[enemy_color][QUEEN], enemy, blockers);
-    attacks |= get_king_pseudo_moves_nocastle(all_pieces_bb[enemy_color][KING], enemy);
+    Bitboard target = 1ULL << square;
+    Bitboard bishops_queens = all_pieces_bb[WHITE][BISHOP] | all_pieces_bb[BLACK][BISHOP] | all_pieces_bb[WHITE][QUEEN] | all_pieces_bb[BLACK][QUEEN];
+    Bitboard rooks_queens = all_pieces_bb[WHITE][ROOK] | all_pieces_bb[BLACK][ROOK] | all_pieces_bb[WHITE][QUEEN] | all_pieces_bb[BLACK][QUEEN];
+    return (get_black_pawn_attacks(target) & all_pieces_bb[WHITE][PAWN]) |
+           (get_white_pawn_attacks(target) & all_pieces_bb[BLACK][PAWN]) |
+           (get_knight_pseudo_moves(target, 0) & (all_pieces_bb[WHITE][KNIGHT] | all_pieces_bb[BLACK][KNIGHT])) |
+           (get_bishop_moves_square(occupancy, square) & bishops_queens) |
+           (get_rook_moves_square(occupancy, square) & rooks_queens) |
+           (get_king_pseudo_moves_nocastle(target, 0) & (all_pieces_bb[WHITE][KING] | all_pieces_bb[BLACK][KING]));
+}
+
+// every square attacked by the pieces of color, the sliders see through the squares of ignored
+Bitboard get_attacks_by(BoardState *board_s, Color color, Bitboard ignored)
+{
+    Bitboard(*pieces)[6] = board_s->all_pieces_bb;
+    Bitboard blockers = (board_s->color_bb[WHITE] | board_s->color_bb[BLACK]) & ~ignored;
+    Bitboard attacks = color == WHITE ? get_white_pawn_attacks(pieces[WHITE][PAWN]) : get_black_pawn_attacks(pieces[BLACK][PAWN]);
+    attacks |= get_knight_pseudo_moves(pieces[color][KNIGHT], 0);
+    attacks |= get_bishop_pseudo_moves(pieces[color][BISHOP] | pieces[color][QUEEN], 0, blockers);
+    attacks |= get_rook_pseudo_moves(pieces[color][ROOK] | pieces[color][QUEEN], 0, blockers);
+    attacks |= get_king_pseudo_moves_nocastle(pieces[color][KING], 0);
     return attacks;
 }
 
 bool is_king_in_check(BoardState *board_s)
 {
-    // in theory we shouldn't need to check all the (pseudo) attacks, en passant rule has no effect on the the king for example
-    // but it's easier to just get all the attacks, hopefully this will not really affect performance
-    Bitboard kings;
-    kings = board_s->all_pieces_bb[board_s->player][KING];
-    Bitboard attacks = get_attacks(board_s);
-    return (attacks & kings) != 0;
-}
-
-Bitboard get_new_attacks(Bitboard all_pieces_bb[2][6], Bitboard enemy, Bitboard blockers, Color enemy_color)
-{
-    Bitboard attacks = 0;
-    attacks |= get_rook_pseudo_moves(all_pieces_bb[enemy_color][ROOK], enemy, blockers);
-    attacks |= get_bishop_pseudo_moves(all_pieces_bb[enemy_color][BISHOP], enemy, blockers);
-    attacks |= get_queen_pseudo_moves(all_pieces_bb[enemy_color][QUEEN], enemy, blockers);
-    return attacks;
-}
-
-bool is_king_left_in_check(Bitboard all_pieces_bb[2][6], Bitboard enemy, Bitboard blockers, Color color)
-{
-    Bitboard king = all_pieces_bb[color][KING];
-    Bitboard attacks = get_new_attacks(all_pieces_bb, enemy, blockers, color ^ 1);
-    return (attacks & king) != 0;
+    Color color = board_s->player;
+    Bitboard king = board_s->all_pieces_bb[color][KING];
+    if (king == 0)
+    {
+        return false;
+    }
+    Bitboard occupancy = board_s->color_bb[WHITE] | board_s->color_bb[BLACK];
+    return (attackers_to(board_s, __builtin_ctzll(king), occupancy) & board_s->color_bb[color ^ 1]) != 0;
 }
 
 void add_move_co(MoveList *move_list, int init_square, int dest_square, PieceType piece_type)
@@ -287,153 +292,360 @@ void add_move_co(MoveList *move_list, int init_square, int dest_square, PieceTyp
         PieceType promotions[] = {QUEEN, KNIGHT, BISHOP, ROOK};
         for (int p = 0; p < 4; p++)
         {
-            move_list->moves[move_list->size].init_co = square_to_coords(init_square);
-            move_list->moves[move_list->size].dest_co = square_to_coords(dest_square);
-            move_list->moves[move_list->size].promotion = promotions[p];
-            move_list->size++;
+            move_list->moves[move_list->size++] = create_move(init_square, dest_square, promotions[p]);
         }
     }
     else
     {
-        move_list->moves[move_list->size].init_co = square_to_coords(init_square);
-        move_list->moves[move_list->size].dest_co = square_to_coords(dest_square);
-        move_list->moves[move_list->size].promotion = EMPTY_PIECE;
-        move_list->size++;
+        move_list->moves[move_list->size++] = create_move(init_square, dest_square, EMPTY_PIECE);
+    }
+}
+
+// pseudo legal destinations of the single piece of piece_type on the square piece (castling excluded)
+Bitboard get_single_piece_pseudo_moves(BoardState *board_s, PieceType piece_type, Bitboard piece)
+{
+    Bitboard piece_moves;
+    switch (piece_type)
+    {
+    case PAWN:
+        if (board_s->player == WHITE)
+            piece_moves = get_white_pawn_pseudo_moves(piece, ~board_s->color_bb[WHITE] & ~board_s->color_bb[BLACK], board_s->color_bb[BLACK], board_s->black_pawn_passant);
+        else
+            piece_moves = get_black_pawn_pseudo_moves(piece, ~board_s->color_bb[WHITE] & ~board_s->color_bb[BLACK], board_s->color_bb[WHITE], board_s->white_pawn_passant);
+        break;
+    case KNIGHT:
+        piece_moves = get_knight_pseudo_moves(piece, board_s->color_bb[board_s->player]);
+        break;
+    case BISHOP:
+        piece_moves = get_bishop_pseudo_moves(piece, board_s->color_bb[board_s->player], board_s->color_bb[WHITE] | board_s->color_bb[BLACK]);
+        break;
+    case ROOK:
+        piece_moves = get_rook_pseudo_moves(piece, board_s->color_bb[board_s->player], board_s->color_bb[WHITE] | board_s->color_bb[BLACK]);
+        break;
+    case QUEEN:
+        piece_moves = get_queen_pseudo_moves(piece, board_s->color_bb[board_s->player], board_s->color_bb[WHITE] | board_s->color_bb[BLACK]);
+        break;
+    case KING:
+        // castling needs the enemy attacks, it is added by the legal generator
+        piece_moves = get_king_pseudo_moves_nocastle(piece, board_s->color_bb[board_s->player]);
+        break;
+    default:
+        piece_moves = 0;
+        break;
     }
+    return piece_moves;
 }
 
-Bitboard get_single_piece_legal_moves(Bitboard piece, Bitboard piece_moves, BoardState *board_s, PieceType piece_type, bool is_check, MoveList *move_list)
+// what the legal generator needs about the king of the player to move, computed once per node
+typedef struct
+{
+    int king_square;
+    Bitboard checkers;
+    Bitboard pinned;     // our pieces that can only move along the line between the king and the pinner
+    Bitboard check_mask; // destinations that answer a single check, every square when not in check
+    Bitboard attacked;   // squares attacked by the enemy, seen through our king so that it can't step back along a checking ray
+} LegalMasks;
+
+static void compute_legal_masks(BoardState *board_s, LegalMasks *masks)
 {
-    int piece_square = __builtin_ctzll(piece);
-    Bitboard legal_moves = 0;
     Color color = board_s->player;
     Color enemy_color = color ^ 1;
+    Bitboard(*pieces)[6] = board_s->all_pieces_bb;
     Bitboard ally = board_s->color_bb[color];
     Bitboard enemy = board_s->color_bb[enemy_color];
-    Bitboard move = 0;
+    Bitboard occupancy = ally | enemy;
+    Bitboard king = pieces[color][KING];
+    masks->king_square = __builtin_ctzll(king);
+    masks->checkers = attackers_to(board_s, masks->king_square, occupancy) & enemy;
+    masks->attacked = get_attacks_by(board_s, enemy_color, king);
+    masks->pinned = 0;
+    // enemy sliders that would see the king through our pieces
+    Bitboard snipers = (get_bishop_moves_square(enemy, masks->king_square) & (pieces[enemy_color][BISHOP] | pieces[enemy_color][QUEEN])) |
+                       (get_rook_moves_square(enemy, masks->king_square) & (pieces[enemy_color][ROOK] | pieces[enemy_color][QUEEN]));
+    while (snipers)
+    {
+        int sniper_square = __builtin_ctzll(snipers);
+        snipers &= snipers - 1;
+        Bitboard blockers = between_bb[masks->king_square][sniper_square] & occupancy;
+        if (blockers && (blockers & (blockers - 1)) == 0)
+        {
+            masks->pinned |= blockers & ally;
+        }
+    }
+    if (masks->checkers == 0)
+    {
+        masks->check_mask = ~0ULL;
+    }
+    else if ((masks->checkers & (masks->checkers - 1)) == 0)
+    {
+        int checker_square = __builtin_ctzll(masks->checkers);
+        masks->check_mask = masks->checkers | between_bb[masks->king_square][checker_square];
+    }
+    else
+    {
+        masks->check_mask = 0; // double check, only the king can move
+    }
+}
 
-    Bitboard blockers = ally | enemy;
-    Bitboard blockers_temp;
-    Bitboard all_pieces_bb_temp[2][6];
+// the en passant capture removes two pieces from the capturing rank, a pin through both can't be seen by the masks
+// so the position after the capture is tested directly
+static bool is_legal_en_passant(BoardState *board_s, LegalMasks *masks, int from_square, int to_square)
+{
+    Color color = board_s->player;
+    int captured_square = color == WHITE ? to_square - 8 : to_square + 8;
+    Bitboard captured = 1ULL << captured_square;
+    Bitboard occupancy = board_s->color_bb[WHITE] | board_s->color_bb[BLACK];
+    occupancy = (occupancy & ~(1ULL << from_square) & ~captured) | (1ULL << to_square);
+    Bitboard attackers = attackers_to(board_s, masks->king_square, occupancy) & board_s->color_bb[color ^ 1] & ~captured;
+    return attackers == 0;
+}
 
-    BoardState board_s_temp_val;
-    BoardState *board_s_temp = &board_s_temp_val;
+// castling: not in check, rook in place, empty path and no attacked square for the king
+static Bitboard get_castling_moves(BoardState *board_s, LegalMasks *masks)
+{
+    Color color = board_s->player;
+    Bitboard king = 1ULL << masks->king_square;
+    Bitboard rooks = board_s->all_pieces_bb[color][ROOK];
+    Bitboard blockers = board_s->color_bb[WHITE] | board_s->color_bb[BLACK];
+    Bitboard castling_moves = 0;
+    if (masks->checkers)
+    {
+        return 0;
+    }
+    bool kingside_castlable = color == WHITE ? board_s->white_kingside_castlable : board_s->black_kingside_castlable;
+    bool queenside_castlable = color == WHITE ? board_s->white_queenside_castlable : board_s->black_queenside_castlable;
+    if (kingside_castlable)
+    {
+        Bitboard kingside_rook = color == WHITE ? 1 : 0x100000000000000;
+        Bitboard kingside_block_mask = color == WHITE ? 6 : 0x600000000000000;
+        Bitboard kingside_threatened_mask = color == WHITE ? 0xe : 0xe00000000000000;
+        if ((rooks & kingside_rook) && (blockers & kingside_block_mask) == 0 && (masks->attacked & kingside_threatened_mask) == 0)
+            castling_moves |= (king >> 2);
+    }
+    if (queenside_castlable)
+    {
+        Bitboard queenside_rook = color == WHITE ? 0x80 : 0x8000000000000000;
+        Bitboard queenside_block_mask = color == WHITE ? 0x70 : 0x7000000000000000;
+        Bitboard queenside_threatened_mask = color == WHITE ? 0x38 : 0x3800000000000000;
+        if ((rooks & queenside_rook) && (blockers & queenside_block_mask) == 0 && (masks->attacked & queenside_threatened_mask) == 0)
+            castling_moves |= (king << 2);
+    }
+    return castling_moves;
+}
+
+// legal destinations of the piece of piece_type on from_square, within targets
+static Bitboard get_single_piece_legal_moves(BoardState *board_s, LegalMasks *masks, PieceType piece_type, int from_square, Bitboard targets)
+{
+    Bitboard piece = 1ULL << from_square;
+    Bitboard piece_moves = get_single_piece_pseudo_moves(board_s, piece_type, piece) & targets;
     if (piece_type == KING)
     {
-        piece_moves &= ~get_attacks(board_s);
+        return (piece_moves & ~masks->attacked) | (get_castling_moves(board_s, masks) & targets);
     }
-    while (piece_moves)
+    if (masks->check_mask == 0)
     {
-        int move_square = __builtin_ctzll(piece_moves);
-        piece_moves &= piece_moves - 1;
-        move = 1ULL << move_square;
-
-        // if the king is in check we need to check if the move removes the check
-        // if it is the king that moves we need to check if it will not be threatened after (more than only the already threatened squares)
-        // In these cases we do the complete move at it is more easy
-        if (is_check || piece_type == KING)
-        {
-            // Make the move on a temporary board state
-            *board_s_temp = *board_s;
-            board_s_temp->all_pieces_bb[color][piece_type] = (board_s->all_pieces_bb[color][piece_type] & ~piece) | move;
-            board_s_temp->color_bb[color] = (board_s->color_bb[color] & ~piece) | move;
-            for (PieceType enemy_piece_type = PAWN; enemy_piece_type <= KING; enemy_piece_type++)
-            {
-                board_s_temp->all_pieces_bb[enemy_color][enemy_piece_type] &= ~move;
-            }
-            board_s_temp->color_bb[enemy_color] &= ~move;
-            if (!is_king_in_check(board_s_temp))
-            {
-                legal_moves |= move;
-                add_move_co(move_list, piece_square, move_square, piece_type);
-            }
-        }
-        else // else we only need to check if the move doesn't put the king in check
+        return 0;
+    }
+    Bitboard en_passant_moves = 0;
+    if (piece_type == PAWN)
+    {
+        int en_passant = board_s->player == WHITE ? board_s->black_pawn_passant : board_s->white_pawn_passant;
+        if (en_passant != -1)
         {
-            // Make the move temporarily only for the blockers and enemies
-            memcpy(all_pieces_bb_temp, board_s->all_pieces_bb, sizeof(all_pieces_bb_temp));
-            for (PieceType enemy_piece_type = PAWN; enemy_piece_type <= KING; enemy_piece_type++)
-            {
-                all_pieces_bb_temp[enemy_color][enemy_piece_type] = board_s->all_pieces_bb[enemy_color][enemy_piece_type] & ~move;
-            }
-            blockers_temp = (blockers & ~piece) | move;
-            if (!is_king_left_in_check(all_pieces_bb_temp, enemy, blockers_temp, color))
+            int en_passant_square = board_s->player == WHITE ? 47 - en_passant : 23 - en_passant;
+            Bitboard en_passant_bb = 1ULL << en_passant_square;
+            if ((piece_moves & en_passant_bb) && is_legal_en_passant(board_s, masks, from_square, en_passant_square))
             {
-                legal_moves |= move;
-                add_move_co(move_list, piece_square, move_square, piece_type);
+                en_passant_moves = en_passant_bb;
             }
+            piece_moves &= ~en_passant_bb;
         }
     }
-    return legal_moves;
+    piece_moves &= masks->check_mask;
+    piece_moves |= en_passant_moves;
+    if (masks->pinned & piece)
+    {
+        piece_moves &= line_bb[masks->king_square][from_square];
+    }
+    return piece_moves;
 }
 
-Bitboard get_piece_moves(BoardState *board_s, PieceType piece_type, bool is_check, MoveList *move_list)
+// targets restricts the destination squares, ~0 for every move
+static void get_piece_moves(BoardState *board_s, LegalMasks *masks, PieceType piece_type, MoveList *move_list, Bitboard targets)
 {
     Bitboard pieces = board_s->all_pieces_bb[board_s->player][piece_type];
-    Bitboard legal_moves = 0;
+    // in double check only the king moves
+    if (piece_type != KING && masks->check_mask == 0)
+    {
+        return;
+    }
     while (pieces)
     {
         int piece_square = __builtin_ctzll(pieces);
         pieces &= pieces - 1;
-        Bitboard piece = 1ULL << piece_square;
-        Bitboard piece_moves;
-        switch (piece_type)
+        Bitboard piece_moves = get_single_piece_legal_moves(board_s, masks, piece_type, piece_square, targets);
+        while (piece_moves)
         {
-        case PAWN:
-            if (board_s->player == WHITE)
-                piece_moves = get_white_pawn_pseudo_moves(piece, ~board_s->color_bb[WHITE] & ~board_s->color_bb[BLACK], board_s->color_bb[BLACK], board_s->black_pawn_passant);
-            else
-                piece_moves = get_black_pawn_pseudo_moves(piece, ~board_s->color_bb[WHITE] & ~board_s->color_bb[BLACK], board_s->color_bb[WHITE], board_s->white_pawn_passant);
-            break;
-        case KNIGHT:
-            piece_moves = get_knight_pseudo_moves(piece, board_s->color_bb[board_s->player]);
-            break;
-        case BISHOP:
-            piece_moves = get_bishop_pseudo_moves(piece, board_s->color_bb[board_s->player], board_s->color_bb[WHITE] | board_s->color_bb[BLACK]);
-            break;
-        case ROOK:
-            piece_moves = get_rook_pseudo_moves(piece, board_s->color_bb[board_s->player], board_s->color_bb[WHITE] | board_s->color_bb[BLACK]);
-            break;
-        case QUEEN:
-            piece_moves = get_queen_pseudo_moves(piece, board_s->color_bb[board_s->player], board_s->color_bb[WHITE] | board_s->color_bb[BLACK]);
-            break;
-        case KING:
-            if (board_s->player == WHITE)
-                piece_moves = get_king_pseudo_moves(piece, board_s->color_bb[WHITE], board_s->color_bb[WHITE] | board_s->color_bb[BLACK], get_attacks(board_s), WHITE, board_s->white_kingside_castlable, board_s->white_queenside_castlable);
-            else
-                piece_moves = get_king_pseudo_moves(piece, board_s->color_bb[BLACK], board_s->color_bb[WHITE] | board_s->color_bb[BLACK], get_attacks(board_s), BLACK, board_s->black_kingside_castlable, board_s->black_queenside_castlable);
-            break;
-        default:
-            piece_moves = 0;
-            break;
+            int move_square = __builtin_ctzll(piece_moves);
+            piece_moves &= piece_moves - 1;
+            add_move_co(move_list, piece_square, move_square, piece_type);
         }
-        legal_moves |= get_single_piece_legal_moves(piece, piece_moves, board_s, piece_type, is_check, move_list);
     }
-    return legal_moves;
 }
 
-MoveList *possible_moves_bb(BoardState *board_s)
+static void generate_moves(BoardState *board_s, MoveList *move_list, Bitboard pawn_targets, Bitboard targets)
 {
-    bool is_check = is_king_in_check(board_s);
-    MoveList *move_list = malloc(sizeof(MoveList));
-    if (move_list == NULL)
-    {
-        return NULL;
-    }
+    LegalMasks masks;
+    compute_legal_masks(board_s, &masks);
     move_list->size = 0;
-    get_piece_moves(board_s, PAWN, is_check, move_list);
-    get_piece_moves(board_s, KNIGHT, is_check, move_list);
-    get_piece_moves(board_s, BISHOP, is_check, move_list);
-    get_piece_moves(board_s, ROOK, is_check, move_list);
-    get_piece_moves(board_s, QUEEN, is_check, move_list);
-    get_piece_moves(board_s, KING, is_check, move_list);
+    get_piece_moves(board_s, &masks, PAWN, move_list, pawn_targets);
+    get_piece_moves(board_s, &masks, KNIGHT, move_list, targets);
+    get_piece_moves(board_s, &masks, BISHOP, move_list, targets);
+    get_piece_moves(board_s, &masks, ROOK, move_list, targets);
+    get_piece_moves(board_s, &masks, QUEEN, move_list, targets);
+    get_piece_moves(board_s, &masks, KING, move_list, targets);
+}
+
+// fill move_list (owned by the caller) with the legal moves of the player to move
+MoveList *possible_moves_bb(BoardState *board_s, MoveList *move_list)
+{
+    generate_moves(board_s, move_list, ~0ULL, ~0ULL);
     return move_list;
 }
 
+// same as possible_moves_bb but only the captures and the promotions, for the quiescence search
+// the quiet moves are masked out before the legality test so they cost nothing
+MoveList *possible_captures_bb(BoardState *board_s, MoveList *move_list)
+{
+    Color color = board_s->player;
+    Bitboard enemy = board_s->color_bb[color ^ 1];
+    Bitboard pawn_targets = enemy | (color == WHITE ? RANK_8 : RANK_1);
+    if (color == WHITE && board_s->black_pawn_passant != -1)
+        pawn_targets |= 1ULL << (47 - board_s->black_pawn_passant);
+    else if (color == BLACK && board_s->white_pawn_passant != -1)
+        pawn_targets |= 1ULL << (23 - board_s->white_pawn_passant);
+    generate_moves(board_s, move_list, pawn_targets, enemy);
+    return move_list;
+}
+
+// the quiet moves: no capture and no promotion, castling included
+MoveList *possible_quiets_bb(BoardState *board_s, MoveList *move_list)
+{
+    Color color = board_s->player;
+    Bitboard empty = ~(board_s->color_bb[WHITE] | board_s->color_bb[BLACK]);
+    Bitboard pawn_targets = empty & ~(color == WHITE ? RANK_8 : RANK_1);
+    if (color == WHITE && board_s->black_pawn_passant != -1)
+        pawn_targets &= ~(1ULL << (47 - board_s->black_pawn_passant));
+    else if (color == BLACK && board_s->white_pawn_passant != -1)
+        pawn_targets &= ~(1ULL << (23 - board_s->white_pawn_passant));
+    generate_moves(board_s, move_list, pawn_targets, empty);
+    return move_list;
+}
+
+// castling squares of the player to move: rook, squares that must be empty, squares the king crosses (from included)
+static bool castling_squares(BoardState *board_s, bool kingside, Bitboard *rook, Bitboard *path, Bitboard *crossed)
+{
+    Color color = board_s->player;
+    if (kingside)
+    {
+        *rook = color == WHITE ? 1 : 0x100000000000000;
+        *path = color == WHITE ? 6 : 0x600000000000000;
+        *crossed = color == WHITE ? 0xe : 0xe00000000000000;
+        return color == WHITE ? board_s->white_kingside_castlable : board_s->black_kingside_castlable;
+    }
+    *rook = color == WHITE ? 0x80 : 0x8000000000000000;
+    *path = color == WHITE ? 0x70 : 0x7000000000000000;
+    *crossed = color == WHITE ? 0x38 : 0x3800000000000000;
+    return color == WHITE ? board_s->white_queenside_castlable : board_s->black_queenside_castlable;
+}
+
+// a move that doesn't come from the generator (transposition table move, killer) could be played here if the king
+// were not in danger: piece of the player to move, reachable destination, promotion piece only on the last rank
+// no attack map and no pin is computed, the king safety is left to is_legal
+bool is_pseudo_legal(BoardState *board_s, Move move)
+{
+    // only what create_move encodes, a promotion field past QUEEN would read as no promotion
+    if (is_empty_move(move) || (move >> 12) > QUEEN)
+    {
+        return false;
+    }
+    Piece piece = get_piece(board_s->board, move_init_coords(move));
+    if (is_empty(piece) || piece.color != board_s->player)
+    {
+        return false;
+    }
+    int from_square = move_init_square(move);
+    int to_square = move_dest_square(move);
+    PieceType promotion = move_promotion(move);
+    bool promotes = piece.name == PAWN && (to_square / 8 == 0 || to_square / 8 == 7);
+    if (promotes ? !(promotion == QUEEN || promotion == KNIGHT || promotion == BISHOP || promotion == ROOK) : promotion != EMPTY_PIECE)
+    {
+        return false;
+    }
+    if (piece.name == KING && abs(to_square - from_square) == 2)
+    {
+        Bitboard rook, path, crossed;
+        if (!castling_squares(board_s, to_square < from_square, &rook, &path, &crossed))
+        {
+            return false;
+        }
+        Bitboard occupancy = board_s->color_bb[WHITE] | board_s->color_bb[BLACK];
+        return (crossed & (1ULL << from_square)) && (board_s->all_pieces_bb[board_s->player][ROOK] & rook) && (occupancy & path) == 0;
+    }
+    return (get_single_piece_pseudo_moves(board_s, piece.name, 1ULL << from_square) & (1ULL << to_square)) != 0;
+}
+
+// a pseudo legal move doesn't leave the king attacked: the attackers of the king are looked up
+// on the occupancy after the move, the piece taken no longer counts
+bool is_legal(BoardState *board_s, Move move)
+{
+    Color color = board_s->player;
+    Bitboard enemy = board_s->color_bb[color ^ 1];
+    int from_square = move_init_square(move);
+    int to_square = move_dest_square(move);
+    Bitboard from = 1ULL << from_square;
+    Bitboard to = 1ULL << to_square;
+    Bitboard occupancy = board_s->color_bb[WHITE] | board_s->color_bb[BLACK];
+    Bitboard king = board_s->all_pieces_bb[color][KING];
+    if (king & from)
+    {
+        if (abs(to_square - from_square) == 2)
+        {
+            Bitboard rook, path, crossed;
+            castling_squares(board_s, to_square < from_square, &rook, &path, &crossed);
+            while (crossed)
+            {
+                int square = __builtin_ctzll(crossed);
+                crossed &= crossed - 1;
+                if (attackers_to(board_s, square, occupancy) & enemy)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        // the king doesn't hide behind itself from a slider
+        return (attackers_to(board_s, to_square, occupancy ^ from) & enemy & ~to) == 0;
+    }
+    Bitboard captured = to;
+    Coords to_coords = move_dest_coords(move);
+    if ((board_s->all_pieces_bb[color][PAWN] & from) && (from_square - to_square) % 8 != 0 && board_s->board[to_coords.x][to_coords.y].name == EMPTY_PIECE)
+    {
+        captured = color == WHITE ? to >> 8 : to << 8; // en passant
+    }
+    occupancy = (occupancy & ~from & ~captured) | to;
+    return (attackers_to(board_s, __builtin_ctzll(king), occupancy) & enemy & ~captured) == 0;
+}
+
+// check a move that doesn't come from the generator, without generating the moves of the position
+bool is_legal_move(BoardState *board_s, Move move)
+{
+    return is_pseudo_legal(board_s, move) && is_legal(board_s, move);
+}
+
 bool is_mate_bb(BoardState *board_s)
 {
-    MoveList *move_list = possible_moves_bb(board_s);
-    bool result = (move_list->size == 0);
-    free(move_list);
-    return result;
+    MoveList move_list;
+    possible_moves_bb(board_s, &move_list);
+    return move_list.size == 0;
 }
@@ -6,10 +6,11 @@
 #include "bitboards_moves.h"
 #include "debug_functions.h"
 #include "transposition_tables.h"
+#include "eval.h"
 
 const int PIECES_PHASE_VALUES[6] = {0, 1, 1, 2, 4, 0};
 
-static Piece empty_piece()
+Piece empty_piece()
 {
     Piece piece;
     piece.name = EMPTY_PIECE;
@@ -17,7 +18,7 @@ static Piece empty_piece()
     return piece;
 }
 
-static Coords empty_coords()
+Coords empty_coords()
 {
     Coords coords;
     coords.x = -1;
@@ -25,30 +26,16 @@ static Coords empty_coords()
     return coords;
 }
 
-Move empty_move()
-{
-    Move move;
-    move.init_co = empty_coords();
-    move.dest_co = empty_coords();
-    move.promotion = EMPTY_PIECE;
-    return move;
-}
-
 bool is_empty(Piece piece)
 {
     return piece.name == EMPTY_PIECE;
 }
 
-static bool is_empty_coords(Coords coords)
+bool is_empty_coords(Coords coords)
 {
     return coords.x == -1 && coords.y == -1;
 }
 
-bool is_empty_move(Move move)
-{
-    return is_empty_coords(move.init_co) && is_empty_coords(move.dest_co) && move.promotion == EMPTY_PIECE;
-}
-
 int coords_to_square(Coords co)
 {
     return co.x * 8 + 7 - co.y;
@@ -62,6 +49,32 @@ Coords square_to_coords(int square)
     return coords;
 }
 
+// pack a move given with board coordinates (UCI input)
+Move coords_to_move(Coords init_coords, Coords dest_coords, PieceType promotion)
+{
+    return create_move(coords_to_square(init_coords), coords_to_square(dest_coords), promotion);
+}
+
+// long algebraic notation as UCI wants it (e2e4, e7e8q), str needs 6 chars
+void move_to_uci(Move move, char *str)
+{
+    Coords init_coords = move_init_coords(move);
+    Coords dest_coords = move_dest_coords(move);
+    str[0] = 'a' + init_coords.y;
+    str[1] = '1' + init_coords.x;
+    str[2] = 'a' + dest_coords.y;
+    str[3] = '1' + dest_coords.x;
+    str[4] = '\0';
+    if (move_promotion(move) != EMPTY_PIECE)
+    {
+        char promo_char = piece_type_to_char(move_promotion(move));
+        if (promo_char >= 'A' && promo_char <= 'Z')
+            promo_char = promo_char - 'A' + 'a'; // UCI uses lowercase
+        str[4] = promo_char;
+        str[5] = '\0';
+    }
+}
+
 PieceType char_to_piece_type(char c)
 {
     // Handle both uppercase and lowercase (UCI uses lowercase for promotions)
@@ -189,7 +202,7 @@ bool insufficient_material(BoardState *board_s)
     return false;
 }
 
-static Piece get_piece(Piece board[8][8], Coords coords)
+Piece get_piece(Piece board[8][8], Coords coords)
 {
     if (is_empty_coords(coords))
     {
@@ -200,17 +213,22 @@ static Piece get_piece(Piece board[8][8], Coords coords)
 
 BoardState *move_pawn_handling(BoardState *board_s, Piece move_piece, Piece dest_piece, Move sel_move)
 {
-    Coords new_coords = sel_move.dest_co;
-    Coords init_coords = sel_move.init_co;
+    Coords new_coords = move_dest_coords(sel_move);
+    Coords init_coords = move_init_coords(sel_move);
+    PieceType promotion = move_promotion(sel_move);
 
     // fprintf(stderr, "move_pawn_handling: color: %c, init_coords: (%d, %d), new_coords: (%d, %d)\n", move_piece.color, init_coords.x, init_coords.y, new_coords.x, new_coords.y);
     // fprintf(stderr, "dest_piece: %c, %c\n", dest_piece.name, dest_piece.color);
     if ((move_piece.color == WHITE && new_coords.x == 7) || (move_piece.color == BLACK && new_coords.x == 0))
     {
-        board_s->board[new_coords.x][new_coords.y].name = sel_move.promotion;
-        board_s->all_pieces_bb[move_piece.color][sel_move.promotion] |= 1ULL << coords_to_square(new_coords);
+        board_s->board[new_coords.x][new_coords.y].name = promotion;
+        board_s->all_pieces_bb[move_piece.color][promotion] |= 1ULL << coords_to_square(new_coords);
         board_s->all_pieces_bb[move_piece.color][PAWN] &= ~(1ULL << coords_to_square(new_coords));
-        board_s->phase += PIECES_PHASE_VALUES[sel_move.promotion];
+        board_s->phase += PIECES_PHASE_VALUES[promotion];
+        board_s->psqt += psq_table[move_piece.color][promotion][new_coords.x][new_coords.y] - psq_table[move_piece.color][PAWN][new_coords.x][new_coords.y];
+        board_s->pawn_hash ^= zobrist_table[(PAWN + 6 * move_piece.color) * 64 + 8 * new_coords.x + new_coords.y];
+        board_s->hash ^= zobrist_table[(PAWN + 6 * move_piece.color) * 64 + 8 * new_coords.x + new_coords.y];                // the pawn doesn't stay on the last rank
+        board_s->hash ^= zobrist_table[(promotion + 6 * move_piece.color) * 64 + 8 * new_coords.x + new_coords.y]; // add the promoted piece
     }
     if (move_piece.color == WHITE && new_coords.x - init_coords.x == 2)
     {
@@ -221,40 +239,49 @@ BoardState *move_pawn_handling(BoardState *board_s, Piece move_piece, Piece dest
     else if (move_piece.color == BLACK && init_coords.x - new_coords.x == 2)
     {
         board_s->black_pawn_passant = new_coords.y;
-        board_s->hash ^= zobrist_table[780 + new_coords.y]; // add en passant square to the hash, 780 = black en passant
+        board_s->hash ^= zobrist_table[772 + new_coords.y]; // add en passant square to the hash, 772 = en passant files (780 is the side to move)
     }
     if (move_piece.color == WHITE && is_empty(dest_piece) && new_coords.y != init_coords.y)
     {
         board_s->board[new_coords.x - 1][new_coords.y] = empty_piece();
         board_s->color_bb[BLACK] &= ~(1ULL << (39 - new_coords.y)); // 39 = 4 * 8 + 7 (to get the fith row)
         board_s->all_pieces_bb[BLACK][PAWN] &= ~(1ULL << (39 - new_coords.y));
-        board_s->hash ^= zobrist_table[6 * 64 + (39 - new_coords.y)]; // remove the captured pawn from the hash, 6 = black pawns
+        board_s->hash ^= zobrist_table[6 * 64 + 8 * 4 + new_coords.y]; // remove the captured pawn from the hash, 6 = black pawns
+        board_s->psqt -= psq_table[BLACK][PAWN][4][new_coords.y];
+        board_s->pawn_hash ^= zobrist_table[6 * 64 + 8 * 4 + new_coords.y];
     }
     else if (move_piece.color == BLACK && is_empty(dest_piece) && new_coords.y != init_coords.y)
     {
         board_s->board[new_coords.x + 1][new_coords.y] = empty_piece();
         board_s->color_bb[WHITE] &= ~(1ULL << (31 - new_coords.y)); // 31 = 3 * 8 + 7 (to get the second row)
         board_s->all_pieces_bb[WHITE][PAWN] &= ~(1ULL << (31 - new_coords.y));
-        board_s->hash ^= zobrist_table[31 - new_coords.y]; // remove the captured pawn from the hash, 0 = white pawns
+        board_s->hash ^= zobrist_table[8 * 3 + new_coords.y]; // remove the captured pawn from the hash, 0 = white pawns
+        board_s->psqt -= psq_table[WHITE][PAWN][3][new_coords.y];
+        board_s->pawn_hash ^= zobrist_table[8 * 3 + new_coords.y];
     }
     return board_s;
 }
 
 BoardState *move_king_handling(BoardState *board_s, Piece piece, Coords init_coords, Coords new_coords)
 {
+    // the rights are only removed from the hash if they were still there
     if (piece.color == WHITE)
     {
+        if (board_s->white_kingside_castlable)
+            board_s->hash ^= zobrist_table[768]; // remove white kingside castling right from the hash, 768 = white kingside
+        if (board_s->white_queenside_castlable)
+            board_s->hash ^= zobrist_table[769]; // remove white queenside castling right from the hash, 769 = white queenside
         board_s->white_kingside_castlable = false;
         board_s->white_queenside_castlable = false;
-        board_s->hash ^= zobrist_table[768]; // remove white kingside castling right from the hash, 768 = white kingside
-        board_s->hash ^= zobrist_table[769]; // remove white queenside castling right from the hash, 769 = white queenside
     }
     else
     {
+        if (board_s->black_kingside_castlable)
+            board_s->hash ^= zobrist_table[770]; // remove black kingside castling right from the hash, 770 = black kingside
+        if (board_s->black_queenside_castlable)
+            board_s->hash ^= zobrist_table[771]; // remove black queenside castling right from the hash, 771 = black queenside
         board_s->black_kingside_castlable = false;
         board_s->black_queenside_castlable = false;
-        board_s->hash ^= zobrist_table[770]; // remove black kingside castling right from the hash, 770 = black kingside
-        board_s->hash ^= zobrist_table[771]; // remove black queenside castling right from the hash, 771 = black queenside
     }
     if (new_coords.y == 6 && init_coords.y == 4)
     {
@@ -267,6 +294,7 @@ BoardState *move_king_handling(BoardState *board_s, Piece piece, Coords init_coo
         board_s->all_pieces_bb[piece.color][ROOK] |= 1UL << (8 * new_coords.x + 2);
         board_s->hash ^= zobrist_table[(ROOK+6*piece.color) * 64 + 8 * new_coords.x + 7];     // remove rook from original square
         board_s->hash ^= zobrist_table[(ROOK+6*piece.color) * 64 + 8 * new_coords.x + 5];     // add rook to new square
+        board_s->psqt += psq_table[piece.color][ROOK][new_coords.x][5] - psq_table[piece.color][ROOK][new_coords.x][7];
     }
     else if (new_coords.y == 2 && init_coords.y == 4)
     {
@@ -279,6 +307,7 @@ BoardState *move_king_handling(BoardState *board_s, Piece piece, Coords init_coo
         board_s->all_pieces_bb[piece.color][ROOK] |= 1UL << (8 * new_coords.x + 4);
         board_s->hash ^= zobrist_table[(ROOK+6*piece.color) * 64 + 8 * new_coords.x + 0];     // remove rook from original square
         board_s->hash ^= zobrist_table[(ROOK+6*piece.color) * 64 + 8 * new_coords.x + 3];     // add rook to new square
+        board_s->psqt += psq_table[piece.color][ROOK][new_coords.x][3] - psq_table[piece.color][ROOK][new_coords.x][0];
     }
     return board_s;
 }
@@ -287,31 +316,35 @@ BoardState *move_rook_handling(BoardState *board_s, Piece piece, Coords init_coo
 {
     if (piece.color == WHITE && init_coords.x == 0 && init_coords.y == 0)
     {
+        if (board_s->white_queenside_castlable)
+            board_s->hash ^= zobrist_table[769]; // remove white queenside castling right from the hash, 769 = white queenside
         board_s->white_queenside_castlable = false;
-        board_s->hash ^= zobrist_table[769]; // remove white queenside castling right from the hash, 769 = white queenside
     }
     else if (piece.color == WHITE && init_coords.x == 0 && init_coords.y == 7)
     {
+        if (board_s->white_kingside_castlable)
+            board_s->hash ^= zobrist_table[768]; // remove white kingside castling right from the hash, 768 = white kingside
         board_s->white_kingside_castlable = false;
-        board_s->hash ^= zobrist_table[768]; // remove white kingside castling right from the hash, 768 = white kingside
     }
     else if (piece.color == BLACK && init_coords.x == 7 && init_coords.y == 0)
     {
+        if (board_s->black_queenside_castlable)
+            board_s->hash ^= zobrist_table[771]; // remove black queenside castling right from the hash, 771 = black queenside
         board_s->black_queenside_castlable = false;
-        board_s->hash ^= zobrist_table[771]; // remove black queenside castling right from the hash, 771 = black queenside
     }
     else if (piece.color == BLACK && init_coords.x == 7 && init_coords.y == 7)
     {
+        if (board_s->black_kingside_castlable)
+            board_s->hash ^= zobrist_table[770]; // remove black kingside castling right from the hash, 770 = black kingside
         board_s->black_kingside_castlable = false;
-        board_s->hash ^= zobrist_table[770]; // remove black kingside castling right from the hash, 770 = black kingside
     }
     return board_s;
 }
 
 BoardState *move_piece(BoardState *board_s, Move sel_move)
 {
-    Coords init_coords = sel_move.init_co;
-    Coords new_coords = sel_move.dest_co;
+    Coords init_coords = move_init_coords(sel_move);
+    Coords new_coords = move_dest_coords(sel_move);
     Piece move_piece = get_piece(board_s->board, init_coords);
     Piece dest_piece = get_piece(board_s->board, new_coords);
     Color color = move_piece.color;
@@ -329,7 +362,7 @@ BoardState *move_piece(BoardState *board_s, Move sel_move)
     }
     if (board_s->black_pawn_passant != -1)
     {
-        board_s->hash ^= zobrist_table[780 + board_s->black_pawn_passant]; // remove en passant square from the hash, 780 = black en passant
+        board_s->hash ^= zobrist_table[772 + board_s->black_pawn_passant]; // remove en passant square from the hash, 772 = en passant files
         board_s->black_pawn_passant = -1;
     }
     // put the piece in the new location
@@ -338,11 +371,19 @@ BoardState *move_piece(BoardState *board_s, Move sel_move)
     board_s->color_bb[color] |= 1ULL << coords_to_square(new_coords);
     board_s->all_pieces_bb[color][move_piece.name] |= 1ULL << coords_to_square(new_coords);
     board_s->hash ^= zobrist_table[(move_piece.name + 6 * color) * 64 + 8*new_coords.x + new_coords.y]; // add the moved piece to the hash
+    board_s->psqt += psq_table[color][move_piece.name][new_coords.x][new_coords.y];
     // remove the piece from the old location
     board_s->board[init_coords.x][init_coords.y] = empty_piece();
     board_s->color_bb[color] ^= 1ULL << coords_to_square(init_coords);
     board_s->all_pieces_bb[color][move_piece.name] ^= 1ULL << coords_to_square(init_coords);
     board_s->hash ^= zobrist_table[(move_piece.name + 6 * color) * 64 + 8*init_coords.x + init_coords.y]; // remove the moved piece from the hash
+    board_s->psqt -= psq_table[color][move_piece.name][init_coords.x][init_coords.y];
+    if (move_piece.name == PAWN)
+    {
+        // a promotion takes the pawn off again in move_pawn_handling
+        board_s->pawn_hash ^= zobrist_table[(PAWN + 6 * color) * 64 + 8*init_coords.x + init_coords.y];
+        board_s->pawn_hash ^= zobrist_table[(PAWN + 6 * color) * 64 + 8*new_coords.x + new_coords.y];
+    }
     // remove the piece from the enemy if it exists
     if (!is_empty(dest_piece))
     {
@@ -350,6 +391,14 @@ BoardState *move_piece(BoardState *board_s, Move sel_move)
         board_s->all_pieces_bb[enemy_color][dest_piece.name] ^= 1ULL << coords_to_square(new_coords);
         board_s->phase -= PIECES_PHASE_VALUES[dest_piece.name];
         board_s->hash ^= zobrist_table[(dest_piece.name + 6 * enemy_color) * 64 + 8*new_coords.x + new_coords.y]; // remove the captured piece from the hash
+        board_s->psqt -= psq_table[enemy_color][dest_piece.name][new_coords.x][new_coords.y];
+        if (dest_piece.name == PAWN)
+            board_s->pawn_hash ^= zobrist_table[(PAWN + 6 * enemy_color) * 64 + 8*new_coords.x + new_coords.y];
+        // a rook taken on its corner can't castle anymore, same as if it had moved
+        if (dest_piece.name == ROOK)
+        {
+            board_s = move_rook_handling(board_s, dest_piece, new_coords, new_coords);
+        }
     }
     // fifty move rule
     if (is_empty(dest_piece) && move_piece.name != PAWN)
@@ -379,6 +428,126 @@ BoardState *move_piece(BoardState *board_s, Move sel_move)
     return board_s;
 }
 
+// play a move in place and remember in undo what unmake_move needs to come back
+// undo is a small record, the board itself is never copied
+void make_move(BoardState *board_s, Move sel_move, UndoInfo *undo)
+{
+    undo->move = sel_move;
+    undo->moved = get_piece(board_s->board, move_init_coords(sel_move));
+    undo->captured = get_piece(board_s->board, move_dest_coords(sel_move));
+    undo->white_kingside_castlable = board_s->white_kingside_castlable;
+    undo->white_queenside_castlable = board_s->white_queenside_castlable;
+    undo->black_kingside_castlable = board_s->black_kingside_castlable;
+    undo->black_queenside_castlable = board_s->black_queenside_castlable;
+    undo->white_pawn_passant = board_s->white_pawn_passant;
+    undo->black_pawn_passant = board_s->black_pawn_passant;
+    undo->fifty_move_rule = board_s->fifty_move_rule;
+    undo->hash = board_s->hash;
+    undo->pawn_hash = board_s->pawn_hash;
+    undo->phase = board_s->phase;
+    undo->psqt = board_s->psqt;
+    move_piece(board_s, sel_move);
+}
+
+static void put_piece(BoardState *board_s, Coords co, PieceType name, Color color)
+{
+    Bitboard square = 1ULL << coords_to_square(co);
+    board_s->board[co.x][co.y].name = name;
+    board_s->board[co.x][co.y].color = color;
+    board_s->color_bb[color] |= square;
+    board_s->all_pieces_bb[color][name] |= square;
+}
+
+static void remove_piece(BoardState *board_s, Coords co)
+{
+    Piece piece = board_s->board[co.x][co.y];
+    Bitboard square = 1ULL << coords_to_square(co);
+    board_s->color_bb[piece.color] &= ~square;
+    board_s->all_pieces_bb[piece.color][piece.name] &= ~square;
+    board_s->board[co.x][co.y] = empty_piece();
+}
+
+// take back the move recorded in undo, it must be the last move made on board_s
+void unmake_move(BoardState *board_s, UndoInfo *undo)
+{
+    Piece moved = undo->moved;
+    if (is_empty(moved))
+    {
+        return;
+    }
+    Coords init_coords = move_init_coords(undo->move);
+    Coords new_coords = move_dest_coords(undo->move);
+
+    // the piece on the destination may be a promoted one, put back what was moved
+    remove_piece(board_s, new_coords);
+    put_piece(board_s, init_coords, moved.name, moved.color);
+    if (!is_empty(undo->captured))
+    {
+        put_piece(board_s, new_coords, undo->captured.name, undo->captured.color);
+    }
+    else if (moved.name == PAWN && new_coords.y != init_coords.y)
+    {
+        // en passant, the taken pawn was beside the initial square
+        Coords taken = {init_coords.x, new_coords.y};
+        put_piece(board_s, taken, PAWN, moved.color ^ 1);
+    }
+    else if (moved.name == KING && init_coords.y == 4 && (new_coords.y == 6 || new_coords.y == 2))
+    {
+        Coords rook_init = {new_coords.x, new_coords.y == 6 ? 7 : 0};
+        Coords rook_dest = {new_coords.x, new_coords.y == 6 ? 5 : 3};
+        remove_piece(board_s, rook_dest);
+        put_piece(board_s, rook_init, ROOK, moved.color);
+    }
+
+    board_s->white_kingside_castlable = undo->white_kingside_castlable;
+    board_s->white_queenside_castlable = undo->white_queenside_castlable;
+    board_s->black_kingside_castlable = undo->black_kingside_castlable;
+    board_s->black_queenside_castlable = undo->black_queenside_castlable;
+    board_s->white_pawn_passant = undo->white_pawn_passant;
+    board_s->black_pawn_passant = undo->black_pawn_passant;
+    board_s->fifty_move_rule = undo->fifty_move_rule;
+    board_s->hash = undo->hash;
+    board_s->pawn_hash = undo->pawn_hash;
+    board_s->phase = undo->phase;
+    board_s->psqt = undo->psqt;
+    board_s->player = moved.color;
+}
+
+// pass: the other player moves next, for the null move pruning of the search
+// no position before it can be repeated, a null move is no game move
+void make_null_move(BoardState *board_s, UndoInfo *undo)
+{
+    undo->move = empty_move();
+    undo->moved = empty_piece();
+    undo->captured = empty_piece();
+    undo->white_pawn_passant = board_s->white_pawn_passant;
+    undo->black_pawn_passant = board_s->black_pawn_passant;
+    undo->fifty_move_rule = board_s->fifty_move_rule;
+    undo->hash = board_s->hash;
+    if (board_s->white_pawn_passant != -1)
+    {
+        board_s->hash ^= zobrist_table[772 + board_s->white_pawn_passant];
+        board_s->white_pawn_passant = -1;
+    }
+    if (board_s->black_pawn_passant != -1)
+    {
+        board_s->hash ^= zobrist_table[772 + board_s->black_pawn_passant];
+        board_s->black_pawn_passant = -1;
+    }
+    board_s->fifty_move_rule = 0;
+    board_s->player = 1 - board_s->player;
+    board_s->hash ^= zobrist_table[780];
+}
+
+void unmake_null_move(BoardState *board_s, UndoInfo *undo)
+{
+    board_s->white_pawn_passant = undo->white_pawn_passant;
+    board_s->black_pawn_passant = undo->black_pawn_passant;
+    board_s->fifty_move_rule = undo->fifty_move_rule;
+    board_s->hash = undo->hash;
+    board_s->player = 1 - board_s->player;
+}
+
 BoardState *init_board()
 {
     BoardState *board_s = malloc(sizeof(BoardState));
@@ -440,6 +609,8 @@ BoardState *init_board()
 
     board_s->phase = 24; // starting phase (all pieces except kings)
     board_s->hash = get_zobrist_hash(board_s);
+    board_s->pawn_hash = get_pawn_zobrist_hash(board_s);
+    board_s->psqt = compute_psqt(board_s);
 
     return board_s;
 }
@@ -548,19 +719,34 @@ BoardState *FEN_to_board(char *FEN)
         }
     }
     i++;
+    board_s->black_pawn_passant = -1;
+    board_s->white_pawn_passant = -1;
     if (FEN[i] != '-')
     {
-        board_s->black_pawn_passant = FEN[i] - 'a';
-        board_s->white_pawn_passant = FEN[i] - 'a';
+        // only the pawn that just made its double step can be taken
+        if (board_s->player == WHITE)
+            board_s->black_pawn_passant = FEN[i] - 'a';
+        else
+            board_s->white_pawn_passant = FEN[i] - 'a';
     }
-    else
+    // past the en passant square, the fifty move counter with all its digits, 0 if the FEN stops before it
+    while (FEN[i] != ' ' && FEN[i] != '\0')
     {
-        board_s->black_pawn_passant = -1;
-        board_s->white_pawn_passant = -1;
+        i++;
+    }
+    while (FEN[i] == ' ')
+    {
+        i++;
+    }
+    board_s->fifty_move_rule = 0;
+    while (FEN[i] >= '0' && FEN[i] <= '9')
+    {
+        board_s->fifty_move_rule = board_s->fifty_move_rule * 10 + FEN[i] - '0';
+        i++;
     }
-    i = i + 2;
-    board_s->fifty_move_rule = FEN[i] - '0';
     board_s->phase = compute_phase(board_s);
     board_s->hash = get_zobrist_hash(board_s);
+    board_s->pawn_hash = get_pawn_zobrist_hash(board_s);
+    board_s->psqt = compute_psqt(board_s);
     return board_s;
 }
@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "chess_logic.h"
+#include "bitboards_moves.h"
+#include "alphabeta.h"
+#include "move_picker.h"
+#include "transposition_tables.h"
+#include "time_manager.h"
+#include "datagen.h"
+
+// self-play games at a fixed number of nodes per move, each position written with its score and the result of its game
+// the threads play their own games, a game is appended to the file in one write once it is over,
+// so that an interrupted run leaves at most a partial record, dropped when the run is resumed
+
+#define DATAGEN_REPORT_INTERVAL 10.0 // seconds between two progress lines
+
+typedef struct
+{
+    DatagenOptions *options;
+    FILE *output;
+    pthread_mutex_t output_lock;
+    atomic_uint_fast64_t written;    // records in the file, the ones of the previous runs too
+    atomic_uint_fast64_t next_game;  // index of the next game, its seed
+    atomic_bool failed;
+    uint64_t games;                  // under output_lock, like the report times
+    uint64_t first_written;
+    double start_time;
+    double last_report;
+} DatagenRun;
+
+// splitmix64, a different stream for each game from consecutive indexes
+static uint64_t mix_seed(uint64_t seed)
+{
+    seed += 0x9E3779B97F4A7C15ULL;
+    seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBULL;
+    return seed ^ (seed >> 31);
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+void datagen_default_options(DatagenOptions *options)
+{
+    memset(options, 0, sizeof(*options));
+    strcpy(options->path, "data.bin");
+    options->positions = 1000000;
+    options->nodes = 5000;
+    options->threads = 1;
+    options->random_plies = 8;
+    options->seed = (uint64_t)(get_time() * 1e6);
+}
+
+static void pack_record(DataRecord *record, BoardState *board_s, int score)
+{
+    memset(record, 0, sizeof(*record));
+    record->occupancy = board_s->color_bb[WHITE] | board_s->color_bb[BLACK];
+    int index = 0;
+    for (Bitboard pieces = record->occupancy; pieces; pieces &= pieces - 1)
+    {
+        int square = __builtin_ctzll(pieces);
+        Piece piece = board_s->board[square / 8][7 - square % 8];
+        record->pieces[index / 2] |= (piece.name + 6 * piece.color) << (4 * (index & 1));
+        index++;
+    }
+    record->score = score;
+    record->player = board_s->player;
+    record->castling = board_s->white_kingside_castlable | board_s->white_queenside_castlable << 1 |
+                       board_s->black_kingside_castlable << 2 | board_s->black_queenside_castlable << 3;
+    record->en_passant = board_s->white_pawn_passant != -1 ? board_s->white_pawn_passant : board_s->black_pawn_passant;
+    record->fifty_move_rule = board_s->fifty_move_rule < 255 ? board_s->fifty_move_rule : 255;
+}
+
+// back to a board, through its FEN: the counters are not all kept, the move number is 1
+BoardState *record_to_board(DataRecord *record)
+{
+    char fen[128];
+    int length = 0;
+    Piece board[8][8];
+    for (int x = 0; x < 8; x++)
+        for (int y = 0; y < 8; y++)
+            board[x][y] = empty_piece();
+    int index = 0;
+    for (Bitboard pieces = record->occupancy; pieces; pieces &= pieces - 1)
+    {
+        int square = __builtin_ctzll(pieces);
+        int code = (record->pieces[index / 2] >> (4 * (index & 1))) & 0xF;
+        board[square / 8][7 - square % 8] = (Piece){code % 6, code / 6};
+        index++;
+    }
+    for (int x = 7; x >= 0; x--)
+    {
+        int empty = 0;
+        for (int y = 0; y < 8; y++)
+        {
+            if (is_empty(board[x][y]))
+            {
+                empty++;
+                continue;
+            }
+            if (empty > 0)
+                fen[length++] = '0' + empty;
+            empty = 0;
+            char name = piece_type_to_char(board[x][y].name);
+            fen[length++] = board[x][y].color == WHITE ? name : name - 'A' + 'a';
+        }
+        if (empty > 0)
+            fen[length++] = '0' + empty;
+        if (x > 0)
+            fen[length++] = '/';
+    }
+    length += sprintf(fen + length, " %c ", record->player == WHITE ? 'w' : 'b');
+    const char *rights = "KQkq";
+    int nb_rights = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (record->castling & (1 << i))
+        {
+            fen[length++] = rights[i];
+            nb_rights++;
+        }
+    }
+    if (nb_rights == 0)
+        fen[length++] = '-';
+    if (record->en_passant >= 0)
+        length += sprintf(fen + length, " %c%c", 'a' + record->en_passant, record->player == WHITE ? '6' : '3');
+    else
+        length += sprintf(fen + length, " -");
+    sprintf(fen + length, " %d 1", record->fifty_move_rule);
+    return FEN_to_board(fen);
+}
+
+// a record must give back the board it was made from, counters included
+// the position has castling rights, an en passant pawn and a fifty move counter of two digits
+static bool check_record_round_trip()
+{
+    char fen[] = "r3k2r/ppp2ppp/8/3pP3/8/8/PPP2PPP/R3K2R w KQkq d6 37 20";
+    BoardState *board_s = FEN_to_board(fen);
+    if (board_s == NULL)
+    {
+        return false;
+    }
+    DataRecord record;
+    pack_record(&record, board_s, 0);
+    BoardState *decoded = record_to_board(&record);
+    bool same = decoded != NULL && memcmp(decoded->board, board_s->board, sizeof(board_s->board)) == 0 &&
+                decoded->player == board_s->player && decoded->hash == board_s->hash &&
+                decoded->white_pawn_passant == board_s->white_pawn_passant && decoded->black_pawn_passant == board_s->black_pawn_passant &&
+                decoded->fifty_move_rule == 37 && board_s->fifty_move_rule == 37;
+    free(board_s);
+    free(decoded);
+    return same;
+}
+
+// random moves from the start position, one more half of the time so that both colors get to move first out of it
+// openings where a side is already clearly winning are thrown away
+static PositionList *random_opening(DatagenRun *run, SearchContext *ctx, TranspoTable *tt, uint64_t *state)
+{
+    SearchLimits limits = {0};
+    limits.nodes = run->options->nodes;
+    while (true)
+    {
+        BoardState *start = init_board();
+        PositionList *history = save_position(start, empty_list());
+        free(start);
+        int plies = run->options->random_plies + (next_random(state) & 1);
+        MoveList moves;
+        bool playable = true;
+        for (int i = 0; i < plies && playable; i++)
+        {
+            possible_moves_bb(history->board_s, &moves);
+            if (moves.size == 0)
+            {
+                playable = false;
+                break;
+            }
+            BoardState next = *history->board_s;
+            move_piece(&next, moves.moves[next_random(state) % moves.size]);
+            history = save_position(&next, history);
+        }
+        if (playable)
+        {
+            possible_moves_bb(history->board_s, &moves);
+            int score;
+            if (moves.size > 0 && !is_empty_move(search_position(ctx, tt, history, &limits, &score)) && abs(score) <= DATAGEN_MAX_OPENING_SCORE)
+            {
+                return history;
+            }
+        }
+        free_position_list(history);
+    }
+}
+
+// play one game, the quiet positions that are not in check are recorded with the score of their search
+// both colors share the table of the worker, its scores are from the side to move so each search reuses the previous ones
+// return the number of records, with the result of the game for white
+static int play_game(DatagenRun *run, SearchContext *ctx, TranspoTable *tt, uint64_t game, DataRecord *records)
+{
+    uint64_t state = mix_seed(run->options->seed + game) | 1;
+    clear_transposition_table(tt, 1);
+    clear_ordering_tables(ctx);
+    PositionList *history = random_opening(run, ctx, tt, &state);
+    SearchLimits limits = {0};
+    limits.nodes = run->options->nodes;
+    int nb_records = 0;
+    int result = 1;
+    for (int ply = 0;; ply++)
+    {
+        BoardState *board_s = history->board_s;
+        MoveList moves;
+        possible_moves_bb(board_s, &moves);
+        if (moves.size == 0)
+        {
+            // the side to move is mated, or it is stalemate
+            result = !is_king_in_check(board_s) ? 1 : board_s->player == WHITE ? 0 : 2;
+            break;
+        }
+        if (ply >= DATAGEN_MAX_PLIES || board_s->fifty_move_rule >= 100 || insufficient_material(board_s) || threefold_hash(board_s->hash, history, 0))
+        {
+            break;
+        }
+        int score;
+        Move move = search_position(ctx, tt, history, &limits, &score);
+        if (abs(score) >= MAX_SCORE - MAX_SEARCH_PLY)
+        {
+            // a mate was found, no need to play it out
+            result = (score > 0) == (board_s->player == WHITE) ? 2 : 0;
+            break;
+        }
+        if (is_empty_move(move))
+        {
+            move = moves.moves[0];
+        }
+        if (!is_king_in_check(board_s) && is_quiet_move(board_s, move))
+        {
+            pack_record(&records[nb_records++], board_s, board_s->player == WHITE ? score : -score);
+        }
+        BoardState next = *board_s;
+        move_piece(&next, move);
+        history = save_position(&next, history);
+    }
+    free_position_list(history);
+    for (int i = 0; i < nb_records; i++)
+    {
+        records[i].result = result;
+    }
+    return nb_records;
+}
+
+static void print_progress(DatagenRun *run)
+{
+    double elapsed = get_time() - run->start_time;
+    uint64_t written = atomic_load(&run->written);
+    uint64_t new_records = written - run->first_written;
+    printf("info string datagen positions %llu/%llu games %llu positions/s %.0f\n", (unsigned long long)written, (unsigned long long)run->options->positions,
+           (unsigned long long)run->games, elapsed > 0 ? new_records / elapsed : 0.0);
+    fflush(stdout);
+}
+
+// the whole game in one write, flushed at once so that an interruption only loses the games being played
+static void save_game(DatagenRun *run, DataRecord *records, int nb_records)
+{
+    pthread_mutex_lock(&run->output_lock);
+    if (nb_records > 0 && (fwrite(records, sizeof(DataRecord), nb_records, run->output) != (size_t)nb_records || fflush(run->output) != 0))
+    {
+        perror("datagen");
+        atomic_store(&run->failed, true);
+    }
+    else
+    {
+        atomic_fetch_add(&run->written, nb_records);
+        run->games++;
+        if (get_time() - run->last_report > DATAGEN_REPORT_INTERVAL)
+        {
+            run->last_report = get_time();
+            print_progress(run);
+        }
+    }
+    pthread_mutex_unlock(&run->output_lock);
+}
+
+static void *datagen_worker(void *arg)
+{
+    DatagenRun *run = (DatagenRun *)arg;
+    SearchContext *ctx = new_search_context();
+    TranspoTable tt;
+    initialize_transposition_table(&tt, DATAGEN_HASH_MB);
+    DataRecord *records = malloc(DATAGEN_MAX_PLIES * sizeof(DataRecord));
+    if (ctx == NULL || tt.buckets == NULL || records == NULL)
+    {
+        fprintf(stderr, "could not allocate a datagen thread\n");
+    }
+    else
+    {
+        while (!atomic_load(&run->failed) && atomic_load(&run->written) < run->options->positions)
+        {
+            uint64_t game = atomic_fetch_add(&run->next_game, 1);
+            int nb_records = play_game(run, ctx, &tt, game, records);
+            save_game(run, records, nb_records);
+        }
+    }
+    free(records);
+    free_transposition_table(&tt);
+    free(ctx);
+    return NULL;
+}
+
+// play games until the file holds options->positions records
+// the records already in the file count, a partial record left by an interrupted run is cut off first
+void run_datagen(DatagenOptions *options)
+{
+    uint64_t existing = 0;
+    struct stat file_stat;
+    if (stat(options->path, &file_stat) == 0)
+    {
+        off_t whole = file_stat.st_size - file_stat.st_size % (off_t)sizeof(DataRecord);
+        if (whole != file_stat.st_size)
+        {
+            fprintf(stderr, "datagen: dropping a partial record at the end of %s\n", options->path);
+            if (truncate(options->path, whole) != 0)
+            {
+                perror("datagen");
+                return;
+            }
+        }
+        existing = whole / sizeof(DataRecord);
+    }
+    if (!check_record_round_trip())
+    {
+        fprintf(stderr, "datagen: a record doesn't decode to the position it was made from, nothing written\n");
+        return;
+    }
+    DatagenRun run = {0};
+    run.options = options;
+    run.output = fopen(options->path, "ab");
+    if (run.output == NULL)
+    {
+        perror("datagen");
+        return;
+    }
+    pthread_mutex_init(&run.output_lock, NULL);
+    atomic_store(&run.written, existing);
+    // a resumed run starts from other seeds than the games already in the file
+    atomic_store(&run.next_game, existing);
+    run.first_written = existing;
+    run.start_time = get_time();
+    run.last_report = run.start_time;
+    int threads = options->threads < 1 ? 1 : options->threads > MAX_THREADS ? MAX_THREADS : options->threads;
+    fprintf(stderr, "datagen: %s, %llu positions already there, %d threads, %llu nodes per move, %d random plies, seed %llu\n", options->path,
+            (unsigned long long)existing, threads, (unsigned long long)options->nodes, options->random_plies, (unsigned long long)options->seed);
+
+    pthread_t thread_ids[MAX_THREADS];
+    int nb_started = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        if (pthread_create(&thread_ids[nb_started], NULL, datagen_worker, &run) != 0)
+        {
+            fprintf(stderr, "could not start datagen thread %d\n", t);
+            break;
+        }
+        nb_started++;
+    }
+    for (int t = 0; t < nb_started; t++)
+    {
+        pthread_join(thread_ids[t], NULL);
+    }
+    fclose(run.output);
+    pthread_mutex_destroy(&run.output_lock);
+    print_progress(&run);
+}
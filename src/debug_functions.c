@@ -1,7 +1,15 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "types.h"
 #include "chess_logic.h"
 #include "debug_functions.h"
+#include "bitboards_moves.h"
+#include "eval.h"
+#include "time_manager.h"
+#include "nnue.h"
+
+#define PAWN_BENCH_CACHED_POSITIONS 1000 // 672 KB of boards, within the L2 cache
 
 void print_bitboard(Bitboard b)
 {
@@ -18,11 +26,9 @@ void print_bitboard(Bitboard b)
 
 void print_move(Move move)
 {
-    char start_col = 'a' + move.init_co.y;
-    char start_row = '1' + (move.init_co.x);
-    char end_col = 'a' + move.dest_co.y;
-    char end_row = '1' + (move.dest_co.x);
-    fprintf(stderr, "%c%c -> %c%c\n", start_col, start_row, end_col, end_row);
+    char move_str[6];
+    move_to_uci(move, move_str);
+    fprintf(stderr, "%s\n", move_str);
 }
 
 void print_move_list(MoveList *move_list)
@@ -30,8 +36,7 @@ void print_move_list(MoveList *move_list)
     fprintf(stderr, "size: %d\n", move_list->size);
     for (int i = 0; i < move_list->size; i++)
     {
-        Move move = move_list->moves[i];
-        fprintf(stderr, "init: %d %d, dest: %d %d\n", move.init_co.x, move.init_co.y, move.dest_co.x, move.dest_co.y);
+        print_move(move_list->moves[i]);
     }
 }
 
@@ -67,7 +72,7 @@ Bitboard get_targetbb_move_list(MoveList *move_list)
     for (int i = 0; i < move_list->size; i++)
     {
         Move move = move_list->moves[i];
-        targetbb |= 1ULL << coords_to_square(move.dest_co);
+        targetbb |= 1ULL << move_dest_square(move);
     }
     return targetbb;
 }
@@ -76,11 +81,7 @@ bool is_in_move_list(MoveList *move_list, Move move)
 {
     for (int i = 0; i < move_list->size; i++)
     {
-        if (move_list->moves[i].init_co.x == move.init_co.x &&
-            move_list->moves[i].init_co.y == move.init_co.y &&
-            move_list->moves[i].dest_co.x == move.dest_co.x &&
-            move_list->moves[i].dest_co.y == move.dest_co.y &&
-            move_list->moves[i].promotion == move.promotion)
+        if (move_list->moves[i] == move)
         {
             return true;
         }
@@ -113,8 +114,7 @@ void print_differences(MoveList *move_list, MoveList *move_list_bb)
         {
             if (!is_in_move_list(move_list_bb, move_list->moves[i]))
             {
-                Move move = move_list->moves[i];
-                fprintf(stderr, "init: %d %d, dest: %d %d\n", move.init_co.x, move.init_co.y, move.dest_co.x, move.dest_co.y);
+                print_move(move_list->moves[i]);
             }
         }
     }
@@ -125,8 +125,7 @@ void print_differences(MoveList *move_list, MoveList *move_list_bb)
         {
             if (!is_in_move_list(move_list, move_list_bb->moves[i]))
             {
-                Move move = move_list_bb->moves[i];
-                fprintf(stderr, "init: %d %d, dest: %d %d\n", move.init_co.x, move.init_co.y, move.dest_co.x, move.dest_co.y);
+                print_move(move_list_bb->moves[i]);
             }
         }
     }
@@ -169,4 +168,168 @@ void print_board_state_full(BoardState *board_s)
     print_bitboard(board_s->all_pieces_bb[BLACK][KING]);
     char color = board_s->player == WHITE ? 'w' : 'b';
     fprintf(stderr, "player: %c\n", color);
-}
\ No newline at end of file
+}
+
+// positions met in random games from the start position, a new game after 200 plies or a mate
+// the generator is seeded with a constant so that two runs compare the same positions
+// undos (if not NULL) gets the move that led to each position, new_games tells which ones follow the start position
+static BoardState *random_positions(int nb_positions, UndoInfo *undos, bool *new_games)
+{
+    BoardState *positions = malloc(nb_positions * sizeof(BoardState));
+    if (positions == NULL)
+    {
+        return NULL;
+    }
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    BoardState *board_s = init_board();
+    MoveList move_list;
+    int ply = 0;
+    for (int i = 0; i < nb_positions; i++)
+    {
+        possible_moves_bb(board_s, &move_list);
+        if (move_list.size == 0 || ply >= 200)
+        {
+            free(board_s);
+            board_s = init_board();
+            ply = 0;
+            possible_moves_bb(board_s, &move_list);
+        }
+        if (new_games != NULL)
+            new_games[i] = ply == 0;
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        UndoInfo undo;
+        make_move(board_s, move_list.moves[seed % move_list.size], &undo);
+        if (undos != NULL)
+            undos[i] = undo;
+        ply++;
+        positions[i] = *board_s;
+    }
+    free(board_s);
+    return positions;
+}
+
+// time both pawn evals over the set a few times, the sums keep the compiler from dropping the calls
+static void time_pawn_evals(BoardState *positions, int nb_positions, int rounds, const char *label)
+{
+    volatile long long sink = 0;
+    double start = get_time();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < nb_positions; i++)
+            sink += pawn_structure_eval_setwise(&positions[i]);
+    double setwise_time = get_time() - start;
+    start = get_time();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < nb_positions; i++)
+            sink += pawn_structure_eval(&positions[i]);
+    double loop_time = get_time() - start;
+    double evals = (double)rounds * nb_positions;
+    printf("%s: pawn by pawn %.1f ns per eval, setwise %.1f ns per eval, speedup %.2f\n", label, 1e9 * loop_time / evals, 1e9 * setwise_time / evals, setwise_time > 0 ? loop_time / setwise_time : 0.0);
+}
+
+// check that the setwise pawn eval gives the scores of the pawn by pawn one, and time both
+void compare_pawn_evals(int nb_positions)
+{
+    BoardState *positions = random_positions(nb_positions, NULL, NULL);
+    if (positions == NULL)
+    {
+        fprintf(stderr, "could not allocate %d positions\n", nb_positions);
+        return;
+    }
+    int mismatches = 0;
+    for (int i = 0; i < nb_positions; i++)
+    {
+        int expected = pawn_structure_eval(&positions[i]);
+        int setwise = pawn_structure_eval_setwise(&positions[i]);
+        if (expected != setwise)
+        {
+            if (mismatches == 0)
+            {
+                fprintf(stderr, "pawn eval %d, setwise %d\n", expected, setwise);
+                print_board_state_full(&positions[i]);
+            }
+            mismatches++;
+        }
+    }
+    printf("pawn eval: %d positions, %d mismatches\n", nb_positions, mismatches);
+    // the whole set comes from memory, fill_pawn_entry evaluates the board the search has just
+    // moved on: the first positions are timed again in a block small enough to stay in the cache
+    int cached = nb_positions < PAWN_BENCH_CACHED_POSITIONS ? nb_positions : PAWN_BENCH_CACHED_POSITIONS;
+    time_pawn_evals(positions, nb_positions, 20, "from memory");
+    time_pawn_evals(positions, cached, 20 * nb_positions / cached, "in cache");
+    fflush(stdout);
+    free(positions);
+}
+
+// time the PeSTO eval against the network, evaluated from scratch and incrementally along the games
+// a random network is used if none is loaded, the speed doesn't depend on the weights
+void compare_evals(int nb_positions)
+{
+    UndoInfo *undos = malloc(nb_positions * sizeof(UndoInfo));
+    bool *new_games = malloc(nb_positions * sizeof(bool));
+    BoardState *positions = random_positions(nb_positions, undos, new_games);
+    NnueAccumulator *accumulators = malloc(2 * sizeof(NnueAccumulator));
+    if (positions == NULL || undos == NULL || new_games == NULL || accumulators == NULL)
+    {
+        fprintf(stderr, "could not allocate %d positions\n", nb_positions);
+        free(positions);
+        free(undos);
+        free(new_games);
+        free(accumulators);
+        return;
+    }
+    bool random_network = !nnue_enabled();
+    if (random_network)
+        nnue_load_random(0x9E3779B97F4A7C15ULL);
+    BoardState *start = init_board();
+    NnueAccumulator start_accumulator;
+    nnue_refresh(&start_accumulator, start);
+    free(start);
+
+    // the incremental accumulators must be the ones of a refresh
+    int mismatches = 0;
+    for (int i = 0; i < nb_positions; i++)
+    {
+        NnueAccumulator *parent = new_games[i] ? &start_accumulator : &accumulators[(i + 1) & 1];
+        nnue_update(&accumulators[i & 1], parent, &undos[i]);
+        NnueAccumulator reference;
+        nnue_refresh(&reference, &positions[i]);
+        mismatches += memcmp(reference.values, accumulators[i & 1].values, sizeof(reference.values)) != 0;
+    }
+
+    int rounds = 20;
+    volatile long long sink = 0;
+    double start_time = get_time();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < nb_positions; i++)
+            sink += eval(&positions[i], NULL);
+    double pesto_time = get_time() - start_time;
+    start_time = get_time();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < nb_positions; i++)
+        {
+            nnue_refresh(&accumulators[0], &positions[i]);
+            sink += nnue_evaluate(&accumulators[0], positions[i].player);
+        }
+    double refresh_time = get_time() - start_time;
+    start_time = get_time();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < nb_positions; i++)
+        {
+            NnueAccumulator *parent = new_games[i] ? &start_accumulator : &accumulators[(i + 1) & 1];
+            nnue_update(&accumulators[i & 1], parent, &undos[i]);
+            sink += nnue_evaluate(&accumulators[i & 1], positions[i].player);
+        }
+    double incremental_time = get_time() - start_time;
+    double evals = (double)rounds * nb_positions;
+    printf("eval: %d positions, %s kernels, %s network, %d accumulator mismatches\n", nb_positions, nnue_kernel_name(), random_network ? "random" : "loaded", mismatches);
+    printf("pesto: %.1f ns per eval, nnue refresh: %.1f ns per eval, nnue incremental: %.1f ns per eval\n", 1e9 * pesto_time / evals, 1e9 * refresh_time / evals, 1e9 * incremental_time / evals);
+    fflush(stdout);
+    if (random_network)
+        nnue_unload();
+    free(positions);
+    free(undos);
+    free(new_games);
+    free(accumulators);
+}
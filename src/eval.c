@@ -2,8 +2,11 @@
 #include "types.h"
 #include "chess_logic.h"
 #include "bitboards_moves.h"
+#include "transposition_tables.h"
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 
 // Using PeSTO's piece-square tables and values
 
@@ -11,6 +14,11 @@ const int PIECES_VALUES_MG[6] = {82, 337, 365, 477, 1025, 0};
 const int PIECES_VALUES_EG[6] = {94, 281, 297, 512, 936, 0};
 
 const int passed_pawn_bonus[8] = {0, 15, 25, 35, 50, 80, 120, 0};
+const int ISOLATED_PAWN_PENALTY = 15;
+const int DOUBLED_PAWN_PENALTY = 5;
+const int PROTECTED_PAWN_BONUS = 10;
+const int CASTLING_RIGHTS_BONUS = 10;
+const int UNCASTLED_KING_PENALTY = 50; // king moved to the centre files instead of castling, before the endgame
 
 const int KING_TABLE_MG[8][8] = {
     {-65,  23,  16, -15, -56, -34,   2,  13},
@@ -162,8 +170,7 @@ const int (*PESTO_TABLE_EG[6])[8] = {
     KING_TABLE_EG
 };
 
-int mg_table[2][6][8][8];
-int eg_table[2][6][8][8];
+int32_t psq_table[2][6][8][8];
 
 void init_eval_tables()
 {
@@ -177,13 +184,13 @@ void init_eval_tables()
                 {
                     if (color == WHITE)
                     {
-                        mg_table[color][piece][i][j] = PESTO_TABLE_MG[piece][i][j] + PIECES_VALUES_MG[piece];
-                        eg_table[color][piece][i][j] = PESTO_TABLE_EG[piece][i][j] + PIECES_VALUES_EG[piece];
+                        psq_table[color][piece][i][j] = make_score(PESTO_TABLE_MG[piece][i][j] + PIECES_VALUES_MG[piece],
+                                                                   PESTO_TABLE_EG[piece][i][j] + PIECES_VALUES_EG[piece]);
                     }
                     else
                     {
-                        mg_table[color][piece][i][j] = PESTO_TABLE_MG[piece][7 - i][j] + PIECES_VALUES_MG[piece];
-                        eg_table[color][piece][i][j] = PESTO_TABLE_EG[piece][7 - i][j] + PIECES_VALUES_EG[piece];
+                        psq_table[color][piece][i][j] = -make_score(PESTO_TABLE_MG[piece][7 - i][j] + PIECES_VALUES_MG[piece],
+                                                                    PESTO_TABLE_EG[piece][7 - i][j] + PIECES_VALUES_EG[piece]);
                     }
                 }
             }
@@ -213,6 +220,36 @@ const Bitboard under_over_ranks[2][8] = {
     {0x0000000000000000, 0x00000000000000FF, 0x000000000000FFFF, 0x0000000000FFFFFF, 0x00000000FFFFFFFF, 0x000000FFFFFFFFFF, 0x0000FFFFFFFFFFFF, 0x00FFFFFFFFFFFFFF},
     {0xFFFFFFFFFFFFFF00, 0xFFFFFFFFFFFF0000, 0xFFFFFFFFFF000000, 0xFFFFFFFF00000000, 0xFFFFFF0000000000, 0xFFFF000000000000, 0xFF00000000000000, 0x0000000000000000}};
 
+static Bitboard north_fill(Bitboard bb)
+{
+    bb |= bb << 8;
+    bb |= bb << 16;
+    bb |= bb << 32;
+    return bb;
+}
+
+static Bitboard south_fill(Bitboard bb)
+{
+    bb |= bb >> 8;
+    bb |= bb >> 16;
+    bb |= bb >> 32;
+    return bb;
+}
+
+// the files on both sides of the given squares, and the squares themselves
+static Bitboard with_adjacent_files(Bitboard bb)
+{
+    return bb | ((bb << 1) & ~FILE_H) | ((bb >> 1) & ~FILE_A);
+}
+
+// rank mask of one_pawn_structure_eval, it used to be RANK_1 << x*8 on an int:
+// the shift wraps at 32 bits and the mask of rank 4 comes out sign extended.
+// the scores were tuned that way, it's spelled out instead of left to the compiler
+static Bitboard pawn_row_mask(int x)
+{
+    return (Bitboard)(int32_t)(0xFFu << (x * 8 % 32));
+}
+
 // evaluate pawn structure
 int one_pawn_structure_eval(BoardState *board_s, int x, int y, Color color)
 {
@@ -222,8 +259,8 @@ int one_pawn_structure_eval(BoardState *board_s, int x, int y, Color color)
     Bitboard in_front_mask = under_over_ranks[color ^ 1][x];
     Bitboard left_file = FILE_H << (7 - y + 1);
     Bitboard pwn_file = FILE_H << (7-y);
-    Bitboard right_file = FILE_H << (7-y-1);
-    Bitboard pwn_row = RANK_1 << x*8;
+    Bitboard right_file = y == 7 ? 1ULL << 63 : FILE_H << (7-y-1); // was FILE_H << -1, a8 once the cpu masks the count
+    Bitboard pwn_row = pawn_row_mask(x);
     // Bitboard pwn = pwn_file & pwn_row;
     // int start_row = color == 'w' ? 6 : 1;
     // bool semi_open_file = (pwn_file & opponent_pawns) == 0;
@@ -231,7 +268,7 @@ int one_pawn_structure_eval(BoardState *board_s, int x, int y, Color color)
     // ISOLATED
     if ((pawns & left_file) == 0 && (pawns & right_file) == 0)
     {
-        score -= 15;
+        score -= ISOLATED_PAWN_PENALTY;
     }
 
     // BACKWARD
@@ -246,7 +283,7 @@ int one_pawn_structure_eval(BoardState *board_s, int x, int y, Color color)
     // DOUBLED
     if ((pwn_file & pawns & ~pwn_row) != 0)
     {
-        score -= 5;
+        score -= DOUBLED_PAWN_PENALTY;
     }
 
     // PASSED
@@ -259,7 +296,7 @@ int one_pawn_structure_eval(BoardState *board_s, int x, int y, Color color)
     // PROTECTED or PROTECTS
     if ((pawns & (left_file | right_file) & (pwn_row << 8 | pwn_row >> 8)) != 0)
     {
-        score += 10;
+        score += PROTECTED_PAWN_BONUS;
     }
     return score;
 }
@@ -289,34 +326,147 @@ int pawn_structure_eval(BoardState *board_s)
     return score;
 }
 
-// evaluate the board state for the white player
-// return the score of the board state
-int pieces_eval(PositionList *board_history)
+// flip the files of a bitboard, a <-> h on each rank
+static Bitboard mirror_files(Bitboard bb)
+{
+    bb = ((bb >> 1) & 0x5555555555555555) | ((bb & 0x5555555555555555) << 1);
+    bb = ((bb >> 2) & 0x3333333333333333) | ((bb & 0x3333333333333333) << 2);
+    bb = ((bb >> 4) & 0x0F0F0F0F0F0F0F0F) | ((bb & 0x0F0F0F0F0F0F0F0F) << 4);
+    return bb;
+}
+
+// every file holding one of the squares, fully: the files folded on one rank, then copied on all of them
+static Bitboard file_fill(Bitboard bb)
+{
+    bb |= bb >> 32;
+    bb |= bb >> 16;
+    bb |= bb >> 8;
+    return (bb & RANK_1) * FILE_H;
+}
+
+// number of set bits of each byte, that is of each rank, in the byte itself
+static Bitboard rank_counts(Bitboard bb)
+{
+    bb = bb - ((bb >> 1) & 0x5555555555555555);
+    bb = (bb & 0x3333333333333333) + ((bb >> 2) & 0x3333333333333333);
+    return (bb + (bb >> 4)) & 0x0F0F0F0F0F0F0F0F;
+}
+
+static int count_bits(Bitboard bb)
+{
+    return (int)((rank_counts(bb) * 0x0101010101010101) >> 56);
+}
+
+// same terms as one_pawn_structure_eval for all the pawns of a color at once
+// one_pawn_structure_eval is called with y = square % 8, the bit column, and builds its file
+// masks from 7 - y: its files are the mirrored ones, the mask past the h file is the pawn's own
+// file without rank 1 (FILE_H << 8) and the one past the a file is a8.
+// the mirrored pawns, shifted by one column with these two edge cases, give the same neighbours.
+// its passed test intersects two different files, which is always empty: every pawn gets the bonus.
+// the doubled and protected terms depend on pawn_row_mask, the same for the ranks r and r + 4:
+// each term is worked out as one byte of columns per rank r < 4, the four bytes copied on both halves
+static inline void count_pawn_terms(Bitboard pawns, Color color, PawnTermCounts *counts)
+{
+    Bitboard mirrored = mirror_files(pawns);
+    // neighbours of column c: mirrored pawns on column c - 1 (c = 0 takes the h file but rank 1) and c + 1
+    Bitboard left = ((mirrored & ~FILE_A) << 1) | ((mirrored & FILE_A & ~RANK_1) >> 7);
+    Bitboard right = ((mirrored & ~FILE_H) >> 1) | ((mirrored & (1ULL << 56)) << 7);
+    Bitboard neighbours = left | right;
+    Bitboard isolated = pawns & ~file_fill(neighbours);
+
+    // columns holding a mirrored pawn, and two of them at least, folded in the low byte
+    Bitboard any = mirrored;
+    Bitboard two = any & (any >> 32);
+    any |= any >> 32;
+    two |= (two >> 16) | (any & (any >> 16));
+    any |= any >> 16;
+    two |= (two >> 8) | (any & (any >> 8));
+    any |= any >> 8;
+    // doubled on the ranks 1 to 3: a mirrored pawn of the column not alone or not on that rank,
+    // on rank 4 (row mask of the ranks 4 to 8): a mirrored pawn of the column on the ranks 1 to 3
+    Bitboard doubled_columns = ((any & RANK_1) * 0x010101 & ((two & RANK_1) * 0x010101 | ~mirrored) & 0xFFFFFF)
+                             | ((mirrored | mirrored >> 8 | mirrored >> 16) & RANK_1) << 24;
+    // protected on rank r: a neighbour on the rank above or below, on rank 4 one on the ranks 3 to 8
+    Bitboard above = neighbours >> 16;
+    above |= above >> 32;
+    above |= above >> 16;
+    above |= above >> 8;
+    Bitboard protected_columns = ((neighbours >> 8 | neighbours << 8) & 0xFFFFFF) | (above & RANK_1) << 24;
+    Bitboard doubled = pawns & doubled_columns * 0x100000001;
+    Bitboard protected = pawns & protected_columns * 0x100000001;
+
+    // popcounts of each rank side by side, without the libgcc popcount of a build without -mpopcnt
+    // black advances downwards: its ranks reversed, byte a is the count of advancement a for both colors
+    Bitboard passed_by_rank = rank_counts(pawns);
+    if (color == BLACK)
+        passed_by_rank = __builtin_bswap64(passed_by_rank);
+    counts->isolated = count_bits(isolated);
+    counts->doubled = count_bits(doubled);
+    counts->protected = count_bits(protected);
+    for (int advancement = 0; advancement < 8; advancement++)
+    {
+        counts->passed[advancement] = (int)((passed_by_rank >> 8 * advancement) & 0xFF);
+    }
+}
+
+static int pawns_setwise_eval(Bitboard pawns, Color color)
+{
+    PawnTermCounts counts;
+    count_pawn_terms(pawns, color, &counts);
+    int score = -ISOLATED_PAWN_PENALTY * counts.isolated - DOUBLED_PAWN_PENALTY * counts.doubled + PROTECTED_PAWN_BONUS * counts.protected;
+    for (int advancement = 1; advancement < 7; advancement++)
+    {
+        score += passed_pawn_bonus[advancement] * counts.passed[advancement];
+    }
+    return score;
+}
+
+// how many pawns of each color get each term of the pawn structure eval, for the tuner
+void pawn_structure_terms(BoardState *board_s, PawnTermCounts counts[2])
+{
+    count_pawn_terms(board_s->all_pieces_bb[WHITE][PAWN], WHITE, &counts[WHITE]);
+    count_pawn_terms(board_s->all_pieces_bb[BLACK][PAWN], BLACK, &counts[BLACK]);
+}
+
+// pawn_structure_eval without the loop over the pawns, gives exactly the same scores (checked by pawnbench)
+int pawn_structure_eval_setwise(BoardState *board_s)
+{
+    return pawns_setwise_eval(board_s->all_pieces_bb[WHITE][PAWN], WHITE) - pawns_setwise_eval(board_s->all_pieces_bb[BLACK][PAWN], BLACK);
+}
+
+// sum of the piece square scores from scratch, move_piece keeps board_s->psqt equal to it
+int32_t compute_psqt(BoardState *board_s)
 {
-    BoardState *board_s = board_history->board_s;
     Piece(*board)[8] = board_s->board;
-    int phase = board_s->phase;
-    // printf("eval\n");
-    // evaluate the board
-    int pieces_eval_mg = 0;
-    int pieces_eval_eg = 0;
+    int32_t psqt = 0;
     for (int i = 0; i < 8; i++)
     {
         for (int j = 0; j < 8; j++)
         {
             Piece piece = board[i][j];
-            if (piece.color == WHITE)
+            if (!is_empty(piece))
             {
-                pieces_eval_mg += mg_table[WHITE][piece.name][i][j];
-                pieces_eval_eg += eg_table[WHITE][piece.name][i][j];
-            }
-            else if (piece.color == BLACK)
-            {
-                pieces_eval_mg -= mg_table[BLACK][piece.name][i][j];
-                pieces_eval_eg -= eg_table[BLACK][piece.name][i][j];
+                psqt += psq_table[piece.color][piece.name][i][j];
             }
         }
     }
+    return psqt;
+}
+
+// evaluate the board state for the white player
+// return the score of the board state
+int pieces_eval(BoardState *board_s)
+{
+    int phase = board_s->phase;
+#ifdef DEBUG
+    if (board_s->psqt != compute_psqt(board_s))
+    {
+        fprintf(stderr, "incremental piece square score %d/%d, recomputed %d/%d\n", mg_value(board_s->psqt), eg_value(board_s->psqt), mg_value(compute_psqt(board_s)), eg_value(compute_psqt(board_s)));
+        abort();
+    }
+#endif
+    int pieces_eval_mg = mg_value(board_s->psqt);
+    int pieces_eval_eg = eg_value(board_s->psqt);
     int mgphase = phase;
     if (mgphase > 24)
         mgphase = 24;
@@ -325,38 +475,78 @@ int pieces_eval(PositionList *board_history)
     return (pieces_eval_mg * mgphase + pieces_eval_eg * egphase) / 24;
 }
 
+// castling rights and king in the centre without them, for each color
+void castle_terms(BoardState *board_s, int rights[2], int uncastled[2])
+{
+    rights[WHITE] = board_s->white_kingside_castlable || board_s->white_queenside_castlable;
+    rights[BLACK] = board_s->black_kingside_castlable || board_s->black_queenside_castlable;
+    uncastled[WHITE] = !rights[WHITE] && (board_s->all_pieces_bb[WHITE][KING] & 0x0000000000003838) && board_s->phase > 13;
+    uncastled[BLACK] = !rights[BLACK] && (board_s->all_pieces_bb[BLACK][KING] & 0x3838000000000000) && board_s->phase > 13;
+}
+
 int castle_eval(BoardState *board_s)
 {
     // grère l'éval du castling (avoir l'option de castle est toujours un avantage
     // mais surtout si on l'a pas fait, il ne faut pas bouger le roi au centre)
     // Stockfish faisait pas comme ça bien sûr, y a moyen de rework sur la sécurité du roi
     // Auquel cas, plus faire appel aux phases, lissage etc serait de bon ton
-    int score = 0;
-    if (board_s->white_kingside_castlable || board_s->white_queenside_castlable)
-    {
-        score += 10;
-    }
-    else if ((board_s->all_pieces_bb[WHITE][KING] & 0x0000000000003838) && board_s->phase > 13)
+    int rights[2], uncastled[2];
+    castle_terms(board_s, rights, uncastled);
+    return CASTLING_RIGHTS_BONUS * (rights[WHITE] - rights[BLACK]) - UNCASTLED_KING_PENALTY * (uncastled[WHITE] - uncastled[BLACK]);
+}
+
+// an entry with a zero key is one of a board without pawns: all zero, which is what a cleared table holds
+void clear_pawn_table(PawnTable *table)
+{
+    memset(table->entries, 0, sizeof(table->entries));
+    table->probes = 0;
+    table->hits = 0;
+}
+
+static void fill_pawn_entry(BoardState *board_s, PawnEntry *entry)
+{
+    Bitboard white_pawns = board_s->all_pieces_bb[WHITE][PAWN];
+    Bitboard black_pawns = board_s->all_pieces_bb[BLACK][PAWN];
+    entry->key = board_s->pawn_hash;
+    // the pawn by pawn eval: the setwise one only matches it on a board in the cache at -O2 (pawnbench)
+    entry->score = pawn_structure_eval(board_s);
+    entry->attack_span[WHITE] = north_fill(get_white_pawn_attacks(white_pawns));
+    entry->attack_span[BLACK] = south_fill(get_black_pawn_attacks(black_pawns));
+    entry->passed[WHITE] = white_pawns & ~with_adjacent_files(south_fill(black_pawns >> 8));
+    entry->passed[BLACK] = black_pawns & ~with_adjacent_files(north_fill(white_pawns << 8));
+}
+
+// the pawn structure changes with a few percent of the moves only, its eval is kept by pawn key
+// one entry per index, the new structure always replaces the old one
+PawnEntry *probe_pawn_table(BoardState *board_s, PawnTable *table)
+{
+    PawnEntry *entry = &table->entries[board_s->pawn_hash & (PAWN_TABLE_SIZE - 1)];
+    table->probes++;
+    if (entry->key == board_s->pawn_hash)
     {
-        score -= 50;
+        table->hits++;
     }
-    if (board_s->black_kingside_castlable || board_s->black_queenside_castlable)
+    else
     {
-        score -= 10;
+        fill_pawn_entry(board_s, entry);
     }
-    else if ((board_s->all_pieces_bb[BLACK][KING] & 0x3838000000000000) && board_s->phase > 13)
+#ifdef DEBUG
+    if (board_s->pawn_hash != get_pawn_zobrist_hash(board_s) || entry->score != pawn_structure_eval(board_s))
     {
-        score += 50;
+        fprintf(stderr, "pawn table entry doesn't match the board, score %d instead of %d\n", entry->score, pawn_structure_eval(board_s));
+        abort();
     }
-    return score;
+#endif
+    return entry;
 }
 
-int eval(PositionList *board_history)
+// pawn_table is the one of the calling search thread, NULL to evaluate the pawns from scratch
+int eval(BoardState *board_s, PawnTable *pawn_table)
 {
-    int score = pieces_eval(board_history);
+    int score = pieces_eval(board_s);
     // fprintf(stderr, "Pieces eval: %d\n", score);
     // Pawn structure eval + castle eval : Elo difference: 16.0 +/- 9.5, LOS: 100.0 %, DrawRatio: 61.2 %
-    score += pawn_structure_eval(board_history->board_s);    
-    score += castle_eval(board_history->board_s);            
+    score += pawn_table != NULL ? probe_pawn_table(board_s, pawn_table)->score : pawn_structure_eval(board_s);
+    score += castle_eval(board_s);
     return score;
 }
\ No newline at end of file
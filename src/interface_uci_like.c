@@ -1,28 +1,59 @@
 #include <stdio.h>
+#include <pthread.h>
 #include "alphabeta.h"
 #include "types.h"
 #include "chess_logic.h"
 #include "debug_functions.h"
+#include "perft.h"
+#include "bench.h"
+#include "transposition_tables.h"
+#include "bitboards_moves.h"
+#include "nnue.h"
+#include "datagen.h"
+#include "see.h"
 #include <string.h>
 
-void print_answer(Move best_move)
+static pthread_t search_thread;
+static bool search_running = false;
+static SearchJob search_job;
+
+// the reply we expect to the best move is the best move stored for the position after it
+static Move get_ponder_move(TranspoTable *tt, BoardState *board_s, Move best_move)
 {
-    if (best_move.init_co.x == -1)
+    BoardState next = *board_s;
+    move_piece(&next, best_move);
+    int score;
+    bool found;
+    Move ponder_move = empty_move();
+    tt_lookup(tt, get_zobrist_hash(&next), 0, -MAX_SCORE, MAX_SCORE, &score, &ponder_move, &found);
+    if (!found || is_empty_move(ponder_move) || !is_legal_move(&next, ponder_move))
     {
-        printf("bestmove (none)\n");
-        fflush(stdout);
+        return empty_move();
     }
-    else if (best_move.promotion != EMPTY_PIECE)
+    return ponder_move;
+}
+
+void print_answer(Move best_move, Move ponder_move)
+{
+    if (is_empty_move(best_move))
     {
-        char promo_char = piece_type_to_char(best_move.promotion);
-        if (promo_char >= 'A' && promo_char <= 'Z')
-            promo_char = promo_char - 'A' + 'a'; // UCI uses lowercase
-        printf("bestmove %c%c%c%c%c\n", best_move.init_co.y + 'a', best_move.init_co.x + '1', best_move.dest_co.y + 'a', best_move.dest_co.x + '1', promo_char);
+        printf("bestmove (none)\n");
         fflush(stdout);
     }
     else
     {
-        printf("bestmove %c%c%c%c\n", best_move.init_co.y + 'a', best_move.init_co.x + '1', best_move.dest_co.y + 'a', best_move.dest_co.x + '1');
+        char move_str[6];
+        move_to_uci(best_move, move_str);
+        if (is_empty_move(ponder_move))
+        {
+            printf("bestmove %s\n", move_str);
+        }
+        else
+        {
+            char ponder_str[6];
+            move_to_uci(ponder_move, ponder_str);
+            printf("bestmove %s ponder %s\n", move_str, ponder_str);
+        }
         fflush(stdout);
     }
 }
@@ -31,6 +62,8 @@ PositionList *parse_moves(char *token, PositionList *board_history)
 {
     char last_char;
     Move move;
+    Coords init_coords, dest_coords;
+    PieceType promotion;
     BoardState *new_board_s = malloc(sizeof(BoardState));
     do
     {
@@ -41,18 +74,19 @@ PositionList *parse_moves(char *token, PositionList *board_history)
             break;
         }
         last_char = token[strlen(token) - 1];
-        move.init_co.x = token[1] - '1';
-        move.init_co.y = token[0] - 'a';
-        move.dest_co.x = token[3] - '1';
-        move.dest_co.y = token[2] - 'a';
+        init_coords.x = token[1] - '1';
+        init_coords.y = token[0] - 'a';
+        dest_coords.x = token[3] - '1';
+        dest_coords.y = token[2] - 'a';
         if (token[4] != '\0' && token[4] != '\n')
         {
-            move.promotion = char_to_piece_type(token[4]);
+            promotion = char_to_piece_type(token[4]);
         }
         else
         {
-            move.promotion = EMPTY_PIECE;
+            promotion = EMPTY_PIECE;
         }
+        move = coords_to_move(init_coords, dest_coords, promotion);
         new_board_s = move_piece(new_board_s, move);
         board_history = save_position(new_board_s, board_history);
     } while (last_char != '\n');
@@ -115,29 +149,136 @@ int parse_depth(char *token)
     return atoi(token);
 }
 
-float time_for_move(float time_left, float increment, int moves_to_go)
+// datagen [file <path>] [positions <n>] [nodes <n>] [threads <n>] [plies <n>] [seed <n>]
+// self-play games until the file holds that many positions, the Threads option gives the default number of games at once
+void parse_datagen(char *token)
 {
-    if (time_left == -1)
+    DatagenOptions options;
+    datagen_default_options(&options);
+    options.threads = get_search_threads();
+    while ((token = strtok(NULL, " \n")) != NULL)
     {
-        return 3600; // 1 hour
+        char *value = strtok(NULL, " \n");
+        if (value == NULL)
+        {
+            fprintf(stderr, "Error: datagen %s without a value\n", token);
+            return;
+        }
+        if (strcmp(token, "file") == 0)
+        {
+            strncpy(options.path, value, sizeof(options.path) - 1);
+        }
+        else if (strcmp(token, "positions") == 0)
+        {
+            options.positions = strtoull(value, NULL, 10);
+        }
+        else if (strcmp(token, "nodes") == 0)
+        {
+            options.nodes = strtoull(value, NULL, 10);
+        }
+        else if (strcmp(token, "threads") == 0)
+        {
+            options.threads = atoi(value);
+        }
+        else if (strcmp(token, "plies") == 0)
+        {
+            options.random_plies = atoi(value);
+        }
+        else if (strcmp(token, "seed") == 0)
+        {
+            options.seed = strtoull(value, NULL, 10);
+        }
+        else
+        {
+            fprintf(stderr, "Error: unknown datagen option %s\n", token);
+            return;
+        }
     }
-    float time = time_left / moves_to_go;
-    if (increment > 0)
+    run_datagen(&options);
+}
+
+// perft <depth> [threads <n>] [hash <MB>] divides the current position
+// perftsuite [deep] [threads <n>] [hash <MB>] checks the generator on the known positions
+// the Threads option gives the default number of threads, the table is off by default
+void parse_perft(char *token, PositionList *board_history, bool suite)
+{
+    int depth = 0;
+    bool deep = false;
+    int threads = get_search_threads();
+    size_t hash_mb = 0;
+    while ((token = strtok(NULL, " \n")) != NULL)
     {
-        time += increment;
+        if (strcmp(token, "deep") == 0)
+        {
+            deep = true;
+            continue;
+        }
+        if (strcmp(token, "threads") != 0 && strcmp(token, "hash") != 0)
+        {
+            depth = parse_depth(token);
+            continue;
+        }
+        char *value = strtok(NULL, " \n");
+        if (value == NULL)
+        {
+            fprintf(stderr, "Error: perft %s without a value\n", token);
+            return;
+        }
+        if (strcmp(token, "threads") == 0)
+        {
+            threads = atoi(value);
+        }
+        else
+        {
+            hash_mb = strtoull(value, NULL, 10);
+        }
+    }
+    if (suite)
+    {
+        perft_suite(threads, hash_mb, deep);
     }
-    if (time < 0.01)
-        time = 0.005;
     else
-        time = time - 0.005;
-    return time;
+    {
+        perft_divide_report(board_history->board_s, depth > 0 ? depth : 1, threads, hash_mb);
+    }
+}
+
+static void *search_worker(void *arg)
+{
+    SearchJob *job = arg;
+    BoardState *board_s = job->board_history->board_s;
+    Move best_move = iterative_deepening(job->tt, job->board_history, &job->limits);
+    print_answer(best_move, is_empty_move(best_move) ? empty_move() : get_ponder_move(job->tt, board_s, best_move));
+    BoardState next = *board_s;
+    print_board_debug(move_piece(&next, best_move));
+    return NULL;
+}
+
+// the commands that change the position or the tables wait for the search to be over
+// stop asks it to end now, otherwise the search ends on its own limits
+static void wait_for_search(bool stop)
+{
+    if (!search_running)
+    {
+        return;
+    }
+    if (stop)
+    {
+        stop_search();
+    }
+    pthread_join(search_thread, NULL);
+    search_running = false;
+}
+
+// end of the input: a search with limits may finish, an infinite or ponder one would never end
+void finish_search()
+{
+    wait_for_search(search_job.limits.infinite || search_job.limits.ponder);
 }
 
 void parse_go(char *token, TranspoTable *tt, PositionList *board_history)
 {
-    int depth = 50;
-    double wtime = 0, btime = 0;
-    double winc = 0, binc = 0;
+    SearchLimits limits = {0};
     while (token != NULL)
     {
         token = strtok(NULL, " ");
@@ -145,44 +286,156 @@ void parse_go(char *token, TranspoTable *tt, PositionList *board_history)
         {
             break;
         }
-        if (strcmp(token, "depth") == 0)
+        if (token[strlen(token) - 1] == '\n')
+        {
+            token[strlen(token) - 1] = '\0';
+        }
+        if (strcmp(token, "perft") == 0)
         {
             token = strtok(NULL, " ");
-            depth = parse_depth(token);
+            perft_report(board_history->board_s, token != NULL ? parse_depth(token) : 1);
+            return;
+        }
+        else if (strcmp(token, "infinite") == 0)
+        {
+            limits.infinite = true;
+            continue;
+        }
+        else if (strcmp(token, "ponder") == 0)
+        {
+            limits.ponder = true;
+            continue;
+        }
+        else if (strcmp(token, "") == 0)
+        {
+            continue;
+        }
+        char *value = strtok(NULL, " ");
+        if (value == NULL)
+        {
+            fprintf(stderr, "Error: go %s without a value\n", token);
+            break;
+        }
+        if (strcmp(token, "depth") == 0)
+        {
+            limits.depth = parse_depth(value);
         }
         else if (strcmp(token, "wtime") == 0)
         {
-            token = strtok(NULL, " ");
-            wtime = parse_time_ms(token);
+            limits.time[WHITE] = parse_time_ms(value);
         }
         else if (strcmp(token, "btime") == 0)
         {
-            token = strtok(NULL, " ");
-            btime = parse_time_ms(token);
+            limits.time[BLACK] = parse_time_ms(value);
         }
         else if (strcmp(token, "winc") == 0)
         {
-            token = strtok(NULL, " ");
-            winc = parse_time_ms(token);
+            limits.increment[WHITE] = parse_time_ms(value);
         }
         else if (strcmp(token, "binc") == 0)
         {
-            token = strtok(NULL, " ");
-            binc = parse_time_ms(token);
+            limits.increment[BLACK] = parse_time_ms(value);
+        }
+        else if (strcmp(token, "movestogo") == 0)
+        {
+            limits.movestogo = parse_depth(value);
+        }
+        else if (strcmp(token, "movetime") == 0)
+        {
+            limits.movetime = parse_time_ms(value);
+        }
+        else if (strcmp(token, "nodes") == 0)
+        {
+            limits.nodes = strtoull(value, NULL, 10);
+        }
+        else if (strcmp(token, "mate") == 0)
+        {
+            limits.mate = parse_depth(value);
         }
         else
         {
             fprintf(stderr, "Error: unknown go command\n");
         }
     }
-    double time_left = board_history->board_s->player == WHITE ? wtime : btime;
-    double increment = board_history->board_s->player == WHITE ? winc : binc;
-    int moves_to_go = 40; // default value
-    double time = time_for_move(time_left, increment, moves_to_go);
-    Color color = board_history->board_s->player;
-    Move best_move = iterative_deepening(tt, board_history, color, depth, time);
-    print_answer(best_move);
-    print_board_debug(move_piece(board_history->board_s, best_move));
+    // the uci thread keeps reading stdin while the worker searches
+    search_job.tt = tt;
+    search_job.board_history = board_history;
+    search_job.limits = limits;
+    prepare_search(limits.ponder);
+    if (pthread_create(&search_thread, NULL, search_worker, &search_job) != 0)
+    {
+        fprintf(stderr, "could not start the search thread, searching on the uci thread\n");
+        search_worker(&search_job);
+        return;
+    }
+    search_running = true;
+}
+
+void parse_setoption(char *token, TranspoTable *tt)
+{
+    char name[64] = {0};
+    char value[256] = {0};
+    token = strtok(NULL, " ");
+    if (token == NULL || strcmp(token, "name") != 0)
+    {
+        fprintf(stderr, "Error: malformed setoption command\n");
+        return;
+    }
+    token = strtok(NULL, " \n");
+    if (token == NULL)
+    {
+        fprintf(stderr, "Error: malformed setoption command\n");
+        return;
+    }
+    strncpy(name, token, sizeof(name) - 1);
+    token = strtok(NULL, " \n");
+    if (token != NULL && strcmp(token, "value") == 0)
+    {
+        token = strtok(NULL, " \n");
+        if (token != NULL)
+        {
+            strncpy(value, token, sizeof(value) - 1);
+        }
+    }
+    if (strcmp(name, "Threads") == 0)
+    {
+        set_search_threads(atoi(value));
+    }
+    else if (strcmp(name, "EvalFile") == 0)
+    {
+        // an empty value (or <empty>) goes back to the PeSTO eval,
+        // a file that can't be loaded leaves the current eval, network or PeSTO, as it was
+        if (value[0] == '\0' || strcmp(value, "<empty>") == 0)
+        {
+            nnue_unload();
+        }
+        else if (!nnue_load(value))
+        {
+            printf("info string could not load the network %s, still using %s\n", value, nnue_enabled() ? "the previous network" : "the PeSTO eval");
+            fflush(stdout);
+        }
+    }
+    else if (strcmp(name, "Ponder") == 0)
+    {
+        // nothing to set, the GUI decides when to send go ponder
+    }
+    else if (strcmp(name, "Hash") == 0)
+    {
+        long long size_mb = atoll(value);
+        if (size_mb < 1)
+            size_mb = 1;
+        if (size_mb > TT_MAX_MB)
+            size_mb = TT_MAX_MB;
+        if (!resize_transposition_table(tt, size_mb, get_search_threads()))
+        {
+            // keep an engine that can search, with the default size
+            resize_transposition_table(tt, TT_DEFAULT_MB, get_search_threads());
+        }
+    }
+    else if (!set_search_param(name, atoi(value)))
+    {
+        fprintf(stderr, "Error: unknown option %s\n", name);
+    }
 }
 
 void handle_uci_command(char *command, TranspoTable *tt, PositionList *board_history)
@@ -199,16 +452,80 @@ void handle_uci_command(char *command, TranspoTable *tt, PositionList *board_his
         fflush(stdout);
         printf("id author Achille Correge\n");
         fflush(stdout);
+        printf("option name Threads type spin default 1 min 1 max %d\n", MAX_THREADS);
+        fflush(stdout);
+        printf("option name Hash type spin default %d min 1 max %d\n", TT_DEFAULT_MB, TT_MAX_MB);
+        fflush(stdout);
+        printf("option name Ponder type check default false\n");
+        fflush(stdout);
+        printf("option name EvalFile type string default <empty>\n");
+        fflush(stdout);
+        print_search_params();
         printf("uciok\n");
         fflush(stdout);
     }
     else if (strcmp(token, "isready\n") == 0)
     {
+        // answered at once, even during a search
         printf("readyok\n");
         fflush(stdout);
     }
+    else if (strcmp(token, "stop\n") == 0)
+    {
+        wait_for_search(true);
+    }
+    else if (strcmp(token, "ponderhit\n") == 0)
+    {
+        ponderhit();
+    }
+    else if (strncmp(token, "pawnbench", 9) == 0)
+    {
+        // pawnbench [positions]: the setwise pawn eval against the pawn by pawn one
+        wait_for_search(true);
+        token = strtok(NULL, " ");
+        int nb_positions = token != NULL ? parse_depth(token) : 0;
+        compare_pawn_evals(nb_positions > 0 ? nb_positions : 100000);
+    }
+    else if (strncmp(token, "bench", 5) == 0)
+    {
+        // bench [depth]: fixed positions searched single threaded, the same nodes on every run
+        wait_for_search(true);
+        token = strtok(NULL, " ");
+        int depth = token != NULL ? parse_depth(token) : 0;
+        bench(depth > 0 ? depth : BENCH_DEFAULT_DEPTH);
+    }
+    else if (strncmp(token, "evalbench", 9) == 0)
+    {
+        // evalbench [positions]: the PeSTO eval against the network, from scratch and incremental
+        wait_for_search(true);
+        token = strtok(NULL, " ");
+        int nb_positions = token != NULL ? parse_depth(token) : 0;
+        compare_evals(nb_positions > 0 ? nb_positions : 100000);
+    }
+    else if (strncmp(token, "datagen", 7) == 0)
+    {
+        wait_for_search(true);
+        parse_datagen(token);
+    }
+    else if (strncmp(token, "seesuite", 8) == 0)
+    {
+        // seesuite: the exchanges of the SEE positions against their known values
+        wait_for_search(true);
+        see_suite();
+    }
+    else if (strncmp(token, "perftsuite", 10) == 0)
+    {
+        wait_for_search(true);
+        parse_perft(token, board_history, true);
+    }
+    else if (strncmp(token, "perft", 5) == 0)
+    {
+        wait_for_search(true);
+        parse_perft(token, board_history, false);
+    }
     else if (strncmp(token, "position", 8) == 0)
     {
+        wait_for_search(true);
         free_position_list(board_history->tail);
         if (board_history->board_s != NULL)
             free(board_history->board_s);
@@ -217,19 +534,27 @@ void handle_uci_command(char *command, TranspoTable *tt, PositionList *board_his
         free(new_board_history);
         print_board_debug(board_history->board_s);
     }
+    else if (strncmp(token, "setoption", 9) == 0)
+    {
+        wait_for_search(true);
+        parse_setoption(token, tt);
+    }
     else if (strncmp(token, "go", 2) == 0)
     {
+        wait_for_search(true);
         print_board_debug(board_history->board_s);
         parse_go(token, tt, board_history);
     }
     else if (strcmp(token, "quit\n") == 0)
     {
-        // do nothing
+        wait_for_search(true);
     }
     else if (strcmp(token, "ucinewgame\n") == 0)
     {
-        // for the moment, do nothing
-        // initialize_transposition_table(tt, 1 << 20);
+        wait_for_search(true);
+        // nothing learnt in the previous game is kept
+        clear_transposition_table(tt, get_search_threads());
+        clear_search_tables();
     }
     else
     {
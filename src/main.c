@@ -10,6 +10,7 @@
 #include "debug_functions.h"
 #include "eval.h"
 #include "bitboards_moves.h"
+#include "bench.h"
 #define MAX_MSG_LENGTH 32000
 
 void print_board(BoardState *board_s)
@@ -41,7 +42,7 @@ void print_board(BoardState *board_s)
 void test_self_engine(double time_white, double time_black)
 {    
     TranspoTable global_transpo_table;
-    initialize_transposition_table(&global_transpo_table, 1 << 20);
+    initialize_transposition_table(&global_transpo_table, TT_DEFAULT_MB);
 
     PositionList *board_history = empty_list();
     BoardState *board_s = init_board();
@@ -58,14 +59,10 @@ void test_self_engine(double time_white, double time_black)
         fflush(stdin); // option ONE to clean stdin
         getchar();     // wait for ENTER
         */
-        if (color == WHITE)
-        {
-            move = iterative_deepening(&global_transpo_table, board_history, color, 20, time_white);
-        }
-        else
-        {
-            move = iterative_deepening(&global_transpo_table, board_history, color, 20, time_black);
-        }
+        SearchLimits limits = {0};
+        limits.depth = 20;
+        limits.movetime = color == WHITE ? time_white : time_black;
+        move = iterative_deepening(&global_transpo_table, board_history, &limits);
         board_s = move_piece(board_s, move);
         board_history = save_position(board_s, board_history);
 
@@ -109,7 +106,7 @@ void test_uci_solo()
     char buffer[MAX_MSG_LENGTH] = {0};
 
     TranspoTable global_transpo_table;
-    initialize_transposition_table(&global_transpo_table, 1 << 20);
+    initialize_transposition_table(&global_transpo_table, TT_DEFAULT_MB);
 
     PositionList *board_history = malloc(sizeof(PositionList));
     if (board_history == NULL)
@@ -151,7 +148,7 @@ void answer_uci()
     char buffer[MAX_MSG_LENGTH] = {0};
 
     TranspoTable global_transpo_table;
-    initialize_transposition_table(&global_transpo_table, 1 << 20);
+    initialize_transposition_table(&global_transpo_table, TT_DEFAULT_MB);
 
     PositionList *board_history = malloc(sizeof(PositionList));
     if (board_history == NULL)
@@ -180,15 +177,23 @@ void answer_uci()
             break;
         }
     }
+    finish_search();
     fprintf(stderr, "Debug: 2\n");
     free_position_list(board_history);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
     // test_self_engine(1.0, 1.0);
     // test_uci_solo();
     init_eval_tables();
+    init_bitboard_tables();
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        // bench [depth]: the node count signature and the speed, then exit
+        bench(argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : BENCH_DEFAULT_DEPTH);
+        return 0;
+    }
     answer_uci(); // C'est dans cette fonction que tout est initialisé
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "chess_logic.h"
+#include "bitboards_moves.h"
+#include "move_picker.h"
+#include "see.h"
+
+// order captures by most valuable victim, then least valuable attacker
+// en passant takes a pawn, a promotion counts as taking the promoted piece
+int mvv_lva(BoardState *board_s, Move move)
+{
+    Coords init_coords = move_init_coords(move);
+    Coords dest_coords = move_dest_coords(move);
+    PieceType attacker = board_s->board[init_coords.x][init_coords.y].name;
+    PieceType victim = board_s->board[dest_coords.x][dest_coords.y].name;
+    if (victim == EMPTY_PIECE)
+    {
+        victim = move_promotion(move) != EMPTY_PIECE ? move_promotion(move) : PAWN;
+    }
+    return victim * 8 - attacker;
+}
+
+// a capture of a piece worth at least the capturing one can't lose material, the others go through SEE
+static bool is_losing_capture(BoardState *board_s, Move move)
+{
+    Coords init_coords = move_init_coords(move);
+    Coords dest_coords = move_dest_coords(move);
+    PieceType attacker = board_s->board[init_coords.x][init_coords.y].name;
+    PieceType victim = board_s->board[dest_coords.x][dest_coords.y].name;
+    if (move_promotion(move) == EMPTY_PIECE && (attacker == PAWN || (victim != EMPTY_PIECE && victim >= attacker)))
+    {
+        return false;
+    }
+    return see(board_s, move) < 0;
+}
+
+// neither a capture, an en passant capture nor a promotion
+bool is_quiet_move(BoardState *board_s, Move move)
+{
+    Coords init_coords = move_init_coords(move);
+    Coords dest_coords = move_dest_coords(move);
+    Piece moved = board_s->board[init_coords.x][init_coords.y];
+    if (move_promotion(move) != EMPTY_PIECE || board_s->board[dest_coords.x][dest_coords.y].name != EMPTY_PIECE)
+        return false;
+    return !(moved.name == PAWN && init_coords.y != dest_coords.y);
+}
+
+// tt_move is tried first if it is legal here (the table may hold a move of another position)
+// with captures_only the picker stops after the captures, for the quiescence search
+// the quiet moves are ordered with the killers of the ply, the countermove of the previous move and the history
+// the captures that lose material by SEE come last, the quiescence search doesn't get them at all
+void init_move_picker(MovePicker *picker, SearchContext *ctx, int depth, MoveList *move_list, Move tt_move, bool captures_only)
+{
+    BoardState *board_s = &ctx->board;
+    picker->board_s = board_s;
+    picker->move_list = move_list;
+    picker->index = 0;
+    picker->captures_only = captures_only;
+    picker->tt_move = empty_move();
+    picker->nb_bad_captures = 0;
+    picker->bad_index = 0;
+    picker->stage = STAGE_INIT_CAPTURES;
+    if (!captures_only && is_legal_move(board_s, tt_move))
+    {
+        picker->tt_move = tt_move;
+        picker->stage = STAGE_TT_MOVE;
+    }
+    picker->killers[0] = ctx->killers[depth][0];
+    picker->killers[1] = ctx->killers[depth][1];
+    picker->countermove = empty_move();
+    // a null move has no countermove, its empty move would share the slot of h1h1 with every other one
+    if (depth > 0 && !is_empty_move(ctx->stack[depth - 1].undo.move))
+    {
+        Move previous = ctx->stack[depth - 1].undo.move;
+        picker->countermove = ctx->countermoves[move_init_square(previous)][move_dest_square(previous)];
+    }
+    picker->history = ctx->history[board_s->player];
+}
+
+// bring the best scored remaining move to the front, the moves a cutoff skips are never sorted
+static Move pick_best(MovePicker *picker)
+{
+    MoveList *move_list = picker->move_list;
+    int i = picker->index;
+    int best = i;
+    for (int j = i + 1; j < move_list->size; j++)
+    {
+        if (picker->scores[j] > picker->scores[best])
+            best = j;
+    }
+    Move move = move_list->moves[best];
+    move_list->moves[best] = move_list->moves[i];
+    picker->scores[best] = picker->scores[i];
+    picker->index++;
+    return move;
+}
+
+// killers first, then the countermove, then the history which stays below HISTORY_MAX
+static int quiet_score(MovePicker *picker, Move move)
+{
+    if (move == picker->killers[0])
+        return HISTORY_MAX + 3;
+    if (move == picker->killers[1])
+        return HISTORY_MAX + 2;
+    if (move == picker->countermove)
+        return HISTORY_MAX + 1;
+    return picker->history[move_init_square(move)][move_dest_square(move)];
+}
+
+// return the next move to search, or an empty move when there is none left
+Move next_move(MovePicker *picker)
+{
+    Move move;
+    switch (picker->stage)
+    {
+    case STAGE_TT_MOVE:
+        picker->stage = STAGE_INIT_CAPTURES;
+        return picker->tt_move;
+    case STAGE_INIT_CAPTURES:
+        possible_captures_bb(picker->board_s, picker->move_list);
+        for (int i = 0; i < picker->move_list->size; i++)
+        {
+            picker->scores[i] = mvv_lva(picker->board_s, picker->move_list->moves[i]);
+        }
+        picker->index = 0;
+        picker->stage = STAGE_CAPTURES;
+        // fall through
+    case STAGE_CAPTURES:
+        while (picker->index < picker->move_list->size)
+        {
+            move = pick_best(picker);
+            if (move == picker->tt_move)
+                continue;
+            if (is_losing_capture(picker->board_s, move))
+            {
+                if (!picker->captures_only)
+                    picker->bad_captures[picker->nb_bad_captures++] = move;
+                continue;
+            }
+            return move;
+        }
+        if (picker->captures_only)
+        {
+            picker->stage = STAGE_DONE;
+            return empty_move();
+        }
+        picker->stage = STAGE_INIT_QUIETS;
+        // fall through
+    case STAGE_INIT_QUIETS:
+        possible_quiets_bb(picker->board_s, picker->move_list);
+        for (int i = 0; i < picker->move_list->size; i++)
+        {
+            picker->scores[i] = quiet_score(picker, picker->move_list->moves[i]);
+        }
+        picker->index = 0;
+        picker->stage = STAGE_QUIETS;
+        // fall through
+    case STAGE_QUIETS:
+        while (picker->index < picker->move_list->size)
+        {
+            move = pick_best(picker);
+            if (move != picker->tt_move)
+                return move;
+        }
+        picker->stage = STAGE_BAD_CAPTURES;
+        // fall through
+    case STAGE_BAD_CAPTURES:
+        if (picker->bad_index < picker->nb_bad_captures)
+        {
+            return picker->bad_captures[picker->bad_index++];
+        }
+        picker->stage = STAGE_DONE;
+        // fall through
+    case STAGE_DONE:
+    default:
+        return empty_move();
+    }
+}
+
+// history gravity: the bonus shrinks as the entry gets close to the bound, so entries stay in ]-HISTORY_MAX, HISTORY_MAX[
+static void add_history(int *entry, int bonus)
+{
+    *entry += bonus - *entry * abs(bonus) / HISTORY_MAX;
+}
+
+// called when the quiet move best gave a beta cutoff at this depth
+// the quiet moves searched before it without a cutoff are given a malus
+void update_quiet_stats(SearchContext *ctx, int depth, int depth_to_go, Move best, Move *quiets_tried, int nb_quiets_tried)
+{
+    int (*history)[64] = ctx->history[ctx->board.player];
+    int bonus = depth_to_go * depth_to_go;
+    if (bonus > HISTORY_MAX / 4)
+        bonus = HISTORY_MAX / 4;
+    add_history(&history[move_init_square(best)][move_dest_square(best)], bonus);
+    for (int i = 0; i < nb_quiets_tried; i++)
+    {
+        Move move = quiets_tried[i];
+        add_history(&history[move_init_square(move)][move_dest_square(move)], -bonus);
+    }
+    if (ctx->killers[depth][0] != best)
+    {
+        ctx->killers[depth][1] = ctx->killers[depth][0];
+        ctx->killers[depth][0] = best;
+    }
+    if (depth > 0 && !is_empty_move(ctx->stack[depth - 1].undo.move))
+    {
+        Move previous = ctx->stack[depth - 1].undo.move;
+        ctx->countermoves[move_init_square(previous)][move_dest_square(previous)] = best;
+    }
+}
+
+// between two go commands: the killers belong to the old tree and are cleared,
+// the history is halved so that the new position can take over, the countermoves are kept
+void age_ordering_tables(SearchContext *ctx)
+{
+    for (int i = 0; i < MAX_SEARCH_PLY; i++)
+    {
+        ctx->killers[i][0] = empty_move();
+        ctx->killers[i][1] = empty_move();
+    }
+    for (int c = 0; c < 2; c++)
+        for (int from = 0; from < 64; from++)
+            for (int to = 0; to < 64; to++)
+                ctx->history[c][from][to] /= 2;
+}
+
+// a new game: nothing from the previous one is worth keeping
+void clear_ordering_tables(SearchContext *ctx)
+{
+    age_ordering_tables(ctx);
+    memset(ctx->history, 0, sizeof(ctx->history));
+    for (int from = 0; from < 64; from++)
+        for (int to = 0; to < 64; to++)
+            ctx->countermoves[from][to] = empty_move();
+}
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "types.h"
+#include "chess_logic.h"
+#include "nnue.h"
+
+// 768 -> 2x256 -> 1: one accumulator per point of view, the side to move's first in the output layer
+
+static int16_t feature_weights[NNUE_INPUTS][NNUE_HIDDEN] __attribute__((aligned(64)));
+static int16_t feature_biases[NNUE_HIDDEN] __attribute__((aligned(64)));
+static int8_t output_weights[2 * NNUE_HIDDEN] __attribute__((aligned(64)));
+static int32_t output_bias;
+static bool network_loaded = false;
+
+// the feature of a piece seen from perspective: own pieces first, the board flipped for black
+// squares are bitboard squares (h1 = 0), flipping the ranks is xor 56
+static inline int feature_index(Color perspective, Color color, PieceType name, int square)
+{
+    int relative_square = perspective == WHITE ? square : square ^ 56;
+    return ((color != perspective) * 6 + name) * 64 + relative_square;
+}
+
+static bool read_all(FILE *file, void *data, size_t size, size_t count)
+{
+    return fread(data, size, count, file) == count;
+}
+
+// the previous network, or none, is kept when the file can't be read
+bool nnue_load(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        perror("nnue_load");
+        return false;
+    }
+    uint32_t header[3];
+    static int16_t new_feature_weights[NNUE_INPUTS][NNUE_HIDDEN];
+    static int16_t new_feature_biases[NNUE_HIDDEN];
+    static int8_t new_output_weights[2 * NNUE_HIDDEN];
+    int32_t new_output_bias;
+    bool ok = read_all(file, header, sizeof(uint32_t), 3) && header[0] == NNUE_MAGIC && header[1] == NNUE_INPUTS && header[2] == NNUE_HIDDEN &&
+              read_all(file, new_feature_weights, sizeof(int16_t), NNUE_INPUTS * NNUE_HIDDEN) &&
+              read_all(file, new_feature_biases, sizeof(int16_t), NNUE_HIDDEN) &&
+              read_all(file, new_output_weights, sizeof(int8_t), 2 * NNUE_HIDDEN) &&
+              read_all(file, &new_output_bias, sizeof(int32_t), 1);
+    fclose(file);
+    if (!ok)
+    {
+        fprintf(stderr, "%s is not a %dx%d network\n", path, NNUE_INPUTS, NNUE_HIDDEN);
+        return false;
+    }
+    memcpy(feature_weights, new_feature_weights, sizeof(feature_weights));
+    memcpy(feature_biases, new_feature_biases, sizeof(feature_biases));
+    memcpy(output_weights, new_output_weights, sizeof(output_weights));
+    output_bias = new_output_bias;
+    network_loaded = true;
+    fprintf(stderr, "network %s loaded, %s kernels\n", path, nnue_kernel_name());
+    return true;
+}
+
+// small random weights, enough to measure the speed of the network without a trained one
+void nnue_load_random(uint64_t seed)
+{
+    for (int i = 0; i < NNUE_INPUTS * NNUE_HIDDEN + NNUE_HIDDEN + 2 * NNUE_HIDDEN; i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        int value = (int)(seed % 65) - 32;
+        if (i < NNUE_INPUTS * NNUE_HIDDEN)
+            feature_weights[i / NNUE_HIDDEN][i % NNUE_HIDDEN] = value;
+        else if (i < NNUE_INPUTS * NNUE_HIDDEN + NNUE_HIDDEN)
+            feature_biases[i - NNUE_INPUTS * NNUE_HIDDEN] = value;
+        else
+            output_weights[i - NNUE_INPUTS * NNUE_HIDDEN - NNUE_HIDDEN] = value;
+    }
+    output_bias = 0;
+    network_loaded = true;
+}
+
+void nnue_unload()
+{
+    network_loaded = false;
+}
+
+bool nnue_enabled()
+{
+    return network_loaded;
+}
+
+const char *nnue_kernel_name()
+{
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+// acc = parent + the rows of added - the rows of removed, for one perspective
+static void update_values(int16_t *acc, const int16_t *parent, const int16_t **added, int nb_added, const int16_t **removed, int nb_removed)
+{
+#if defined(__AVX2__)
+    for (int i = 0; i < NNUE_HIDDEN; i += 16)
+    {
+        __m256i sum = _mm256_loadu_si256((const __m256i *)&parent[i]);
+        for (int a = 0; a < nb_added; a++)
+            sum = _mm256_add_epi16(sum, _mm256_load_si256((const __m256i *)&added[a][i]));
+        for (int r = 0; r < nb_removed; r++)
+            sum = _mm256_sub_epi16(sum, _mm256_load_si256((const __m256i *)&removed[r][i]));
+        _mm256_storeu_si256((__m256i *)&acc[i], sum);
+    }
+#elif defined(__SSE2__)
+    for (int i = 0; i < NNUE_HIDDEN; i += 8)
+    {
+        __m128i sum = _mm_loadu_si128((const __m128i *)&parent[i]);
+        for (int a = 0; a < nb_added; a++)
+            sum = _mm_add_epi16(sum, _mm_load_si128((const __m128i *)&added[a][i]));
+        for (int r = 0; r < nb_removed; r++)
+            sum = _mm_sub_epi16(sum, _mm_load_si128((const __m128i *)&removed[r][i]));
+        _mm_storeu_si128((__m128i *)&acc[i], sum);
+    }
+#else
+    for (int i = 0; i < NNUE_HIDDEN; i++)
+    {
+        int sum = parent[i];
+        for (int a = 0; a < nb_added; a++)
+            sum += added[a][i];
+        for (int r = 0; r < nb_removed; r++)
+            sum -= removed[r][i];
+        acc[i] = sum;
+    }
+#endif
+}
+
+// from scratch, at the root of a search
+// the rows of all the pieces are summed in one pass over the accumulator
+void nnue_refresh(NnueAccumulator *acc, BoardState *board_s)
+{
+    for (int perspective = WHITE; perspective <= BLACK; perspective++)
+    {
+        const int16_t *rows[64];
+        int nb_rows = 0;
+        for (int color = WHITE; color <= BLACK; color++)
+        {
+            for (int name = PAWN; name <= KING; name++)
+            {
+                Bitboard pieces = board_s->all_pieces_bb[color][name];
+                while (pieces)
+                {
+                    rows[nb_rows++] = feature_weights[feature_index(perspective, color, name, __builtin_ctzll(pieces))];
+                    pieces &= pieces - 1;
+                }
+            }
+        }
+        update_values(acc->values[perspective], feature_biases, rows, nb_rows, NULL, 0);
+    }
+    acc->computed = true;
+}
+
+// the accumulator after the move of undo, from the one before it
+// undo alone tells what changed: moved piece, captured piece, promotion, en passant, castling rook
+void nnue_update(NnueAccumulator *acc, NnueAccumulator *parent, UndoInfo *undo)
+{
+    Piece moved = undo->moved;
+    int from = move_init_square(undo->move);
+    int to = move_dest_square(undo->move);
+    Coords init_coords = move_init_coords(undo->move);
+    Coords new_coords = move_dest_coords(undo->move);
+    PieceType promotion = move_promotion(undo->move);
+    PieceType arrived = promotion != EMPTY_PIECE ? promotion : moved.name;
+    Color color = moved.color;
+
+    // at most two pieces appear and two disappear (castling, or a capture with promotion)
+    Piece added_pieces[2] = {{arrived, color}};
+    int added_squares[2] = {to};
+    int nb_added = 1;
+    Piece removed_pieces[2] = {moved};
+    int removed_squares[2] = {from};
+    int nb_removed = 1;
+    if (!is_empty(undo->captured))
+    {
+        removed_pieces[nb_removed] = undo->captured;
+        removed_squares[nb_removed++] = to;
+    }
+    else if (moved.name == PAWN && new_coords.y != init_coords.y)
+    {
+        Coords taken = {init_coords.x, new_coords.y};
+        removed_pieces[nb_removed] = (Piece){PAWN, color ^ 1};
+        removed_squares[nb_removed++] = coords_to_square(taken);
+    }
+    else if (moved.name == KING && init_coords.y == 4 && (new_coords.y == 6 || new_coords.y == 2))
+    {
+        Coords rook_init = {new_coords.x, new_coords.y == 6 ? 7 : 0};
+        Coords rook_dest = {new_coords.x, new_coords.y == 6 ? 5 : 3};
+        removed_pieces[nb_removed] = (Piece){ROOK, color};
+        removed_squares[nb_removed++] = coords_to_square(rook_init);
+        added_pieces[nb_added] = (Piece){ROOK, color};
+        added_squares[nb_added++] = coords_to_square(rook_dest);
+    }
+
+    for (int perspective = WHITE; perspective <= BLACK; perspective++)
+    {
+        const int16_t *added[2];
+        const int16_t *removed[2];
+        for (int i = 0; i < nb_added; i++)
+            added[i] = feature_weights[feature_index(perspective, added_pieces[i].color, added_pieces[i].name, added_squares[i])];
+        for (int i = 0; i < nb_removed; i++)
+            removed[i] = feature_weights[feature_index(perspective, removed_pieces[i].color, removed_pieces[i].name, removed_squares[i])];
+        update_values(acc->values[perspective], parent->values[perspective], added, nb_added, removed, nb_removed);
+    }
+    acc->computed = true;
+}
+
+// clipped relu of both accumulators times the int8 output weights, the side to move first
+static int32_t output_layer(const int16_t *us, const int16_t *them)
+{
+    int32_t sum = 0;
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max = _mm256_set1_epi16(NNUE_QA);
+    __m256i total = _mm256_setzero_si256();
+    for (int side = 0; side < 2; side++)
+    {
+        const int16_t *values = side == 0 ? us : them;
+        const int8_t *weights = &output_weights[side * NNUE_HIDDEN];
+        for (int i = 0; i < NNUE_HIDDEN; i += 16)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)&values[i]);
+            v = _mm256_min_epi16(_mm256_max_epi16(v, zero), max);
+            __m256i w = _mm256_cvtepi8_epi16(_mm_load_si128((const __m128i *)&weights[i]));
+            total = _mm256_add_epi32(total, _mm256_madd_epi16(v, w));
+        }
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum = _mm_cvtsi128_si32(half);
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(NNUE_QA);
+    __m128i total = _mm_setzero_si128();
+    for (int side = 0; side < 2; side++)
+    {
+        const int16_t *values = side == 0 ? us : them;
+        const int8_t *weights = &output_weights[side * NNUE_HIDDEN];
+        for (int i = 0; i < NNUE_HIDDEN; i += 16)
+        {
+            __m128i bytes = _mm_load_si128((const __m128i *)&weights[i]);
+            // sign extension of the int8 weights without SSE4.1: the byte in the high half, then an arithmetic shift
+            __m128i w_low = _mm_srai_epi16(_mm_unpacklo_epi8(zero, bytes), 8);
+            __m128i w_high = _mm_srai_epi16(_mm_unpackhi_epi8(zero, bytes), 8);
+            __m128i v_low = _mm_min_epi16(_mm_max_epi16(_mm_loadu_si128((const __m128i *)&values[i]), zero), max);
+            __m128i v_high = _mm_min_epi16(_mm_max_epi16(_mm_loadu_si128((const __m128i *)&values[i + 8]), zero), max);
+            total = _mm_add_epi32(total, _mm_madd_epi16(v_low, w_low));
+            total = _mm_add_epi32(total, _mm_madd_epi16(v_high, w_high));
+        }
+    }
+    total = _mm_add_epi32(total, _mm_shuffle_epi32(total, _MM_SHUFFLE(1, 0, 3, 2)));
+    total = _mm_add_epi32(total, _mm_shuffle_epi32(total, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum = _mm_cvtsi128_si32(total);
+#else
+    for (int side = 0; side < 2; side++)
+    {
+        const int16_t *values = side == 0 ? us : them;
+        const int8_t *weights = &output_weights[side * NNUE_HIDDEN];
+        for (int i = 0; i < NNUE_HIDDEN; i++)
+        {
+            int v = values[i] < 0 ? 0 : values[i] > NNUE_QA ? NNUE_QA : values[i];
+            sum += v * weights[i];
+        }
+    }
+#endif
+    return sum;
+}
+
+// score for white in centipawns, like eval
+// kept away from the mate scores whatever the weights
+int nnue_evaluate(NnueAccumulator *acc, Color player)
+{
+    int32_t output = output_layer(acc->values[player], acc->values[player ^ 1]) + output_bias;
+    int64_t scaled = (int64_t)output * NNUE_SCALE / (NNUE_QA * NNUE_QB);
+    int score = scaled > NNUE_MAX_EVAL ? NNUE_MAX_EVAL : scaled < -NNUE_MAX_EVAL ? -NNUE_MAX_EVAL : (int)scaled;
+    return player == WHITE ? score : -score;
+}
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "types.h"
+#include "chess_logic.h"
+#include "bitboards_moves.h"
+#include "perft.h"
+#include "time_manager.h"
+
+// count the leaves of the legal move tree, to check the move generator against known numbers
+// one move list per ply on the C stack, the board is moved in place
+uint64_t perft(BoardState *board_s, int depth)
+{
+    if (depth == 0)
+    {
+        return 1;
+    }
+    MoveList move_list;
+    possible_moves_bb(board_s, &move_list);
+    uint64_t nodes = 0;
+    UndoInfo undo;
+    for (int i = 0; i < move_list.size; i++)
+    {
+        make_move(board_s, move_list.moves[i], &undo);
+        nodes += perft(board_s, depth - 1);
+        unmake_move(board_s, &undo);
+    }
+    return nodes;
+}
+
+// false if the table can't be allocated, perft then runs without it
+bool init_perft_table(PerftTable *table, size_t size_mb)
+{
+    size_t size = 1;
+    while (size * 2 * sizeof(PerftEntry) <= size_mb * 1024 * 1024)
+    {
+        size *= 2;
+    }
+    table->entries = size_mb > 0 ? calloc(size, sizeof(PerftEntry)) : NULL;
+    table->size = table->entries != NULL ? size : 0;
+    return table->entries != NULL;
+}
+
+void free_perft_table(PerftTable *table)
+{
+    free(table->entries);
+    table->entries = NULL;
+    table->size = 0;
+}
+
+static bool probe_perft_table(PerftTable *table, uint64_t hash, int depth, uint64_t *nodes)
+{
+    PerftEntry *entry = &table->entries[hash & (table->size - 1)];
+    uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    uint64_t key = atomic_load_explicit(&entry->key, memory_order_relaxed);
+    if ((key ^ data) != hash || (int)(data & 0xFF) != depth)
+    {
+        return false;
+    }
+    *nodes = data >> 8;
+    return true;
+}
+
+static void store_perft_table(PerftTable *table, uint64_t hash, int depth, uint64_t nodes)
+{
+    PerftEntry *entry = &table->entries[hash & (table->size - 1)];
+    uint64_t data = nodes << 8 | depth;
+    atomic_store_explicit(&entry->key, hash ^ data, memory_order_relaxed);
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+}
+
+// the moves of the last ply are counted, not played: the generator only gives legal moves
+// subtrees of depth 2 and more are kept in the table, when there is one
+static uint64_t perft_bulk(BoardState *board_s, int depth, PerftTable *table)
+{
+    MoveList move_list;
+    possible_moves_bb(board_s, &move_list);
+    if (depth == 1)
+    {
+        return move_list.size;
+    }
+    uint64_t nodes = 0;
+    if (table != NULL && probe_perft_table(table, board_s->hash, depth, &nodes))
+    {
+        return nodes;
+    }
+    UndoInfo undo;
+    for (int i = 0; i < move_list.size; i++)
+    {
+        make_move(board_s, move_list.moves[i], &undo);
+        nodes += perft_bulk(board_s, depth - 1, table);
+        unmake_move(board_s, &undo);
+    }
+    if (table != NULL)
+    {
+        store_perft_table(table, board_s->hash, depth, nodes);
+    }
+    return nodes;
+}
+
+// the root moves are handed out one at a time to the threads, each with its own copy of the board
+typedef struct
+{
+    BoardState *root;
+    MoveList *root_moves;
+    uint64_t *move_nodes;
+    atomic_int next_move;
+    int depth;
+    PerftTable *table;
+} PerftJob;
+
+static void *perft_worker(void *arg)
+{
+    PerftJob *job = (PerftJob *)arg;
+    int i;
+    while ((i = atomic_fetch_add(&job->next_move, 1)) < job->root_moves->size)
+    {
+        BoardState board = *job->root;
+        UndoInfo undo;
+        make_move(&board, job->root_moves->moves[i], &undo);
+        job->move_nodes[i] = job->depth == 1 ? 1 : perft_bulk(&board, job->depth - 1, job->table);
+    }
+    return NULL;
+}
+
+// perft split at the root over threads, with bulk counting and the table if not NULL
+// divide prints the count of each root move, in the order of the generator
+uint64_t perft_divide(BoardState *board_s, int depth, int threads, PerftTable *table, bool divide)
+{
+    if (depth <= 0)
+    {
+        return 1;
+    }
+    MoveList root_moves;
+    possible_moves_bb(board_s, &root_moves);
+    uint64_t move_nodes[MAX_MOVES] = {0};
+    PerftJob job = {board_s, &root_moves, move_nodes, 0, depth, table != NULL && table->size > 0 ? table : NULL};
+    if (threads < 1)
+        threads = 1;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+    pthread_t thread_ids[MAX_THREADS];
+    int nb_started = 0;
+    for (int t = 1; t < threads && t < root_moves.size; t++)
+    {
+        if (pthread_create(&thread_ids[nb_started], NULL, perft_worker, &job) != 0)
+        {
+            break;
+        }
+        nb_started++;
+    }
+    perft_worker(&job);
+    for (int t = 0; t < nb_started; t++)
+    {
+        pthread_join(thread_ids[t], NULL);
+    }
+    uint64_t nodes = 0;
+    for (int i = 0; i < root_moves.size; i++)
+    {
+        nodes += move_nodes[i];
+        if (divide)
+        {
+            char move_str[6];
+            move_to_uci(root_moves.moves[i], move_str);
+            printf("%s: %llu\n", move_str, (unsigned long long)move_nodes[i]);
+        }
+    }
+    return nodes;
+}
+
+// perft from the current position with its speed, on stdout
+void perft_report(BoardState *board_s, int depth)
+{
+    BoardState board = *board_s;
+    double start = get_time();
+    uint64_t nodes = perft(&board, depth);
+    double time_taken = get_time() - start;
+    printf("perft depth: %d, nodes: %llu, time taken: %f, nps: %f\n", depth, (unsigned long long)nodes, time_taken, time_taken > 0 ? nodes / time_taken : 0.0);
+    fflush(stdout);
+}
+
+// divide of the current position, then the total and the speed
+void perft_divide_report(BoardState *board_s, int depth, int threads, size_t hash_mb)
+{
+    PerftTable table = {0};
+    if (hash_mb > 0 && !init_perft_table(&table, hash_mb))
+    {
+        fprintf(stderr, "could not allocate a %zu MB perft table, going without\n", hash_mb);
+    }
+    BoardState board = *board_s;
+    double start = get_time();
+    uint64_t nodes = perft_divide(&board, depth, threads, &table, true);
+    double time_taken = get_time() - start;
+    printf("\nnodes: %llu, time: %.3f s, nps: %.0f, threads: %d, hash: %zu MB\n", (unsigned long long)nodes, time_taken, time_taken > 0 ? nodes / time_taken : 0.0, threads, table.size * sizeof(PerftEntry) / (1024 * 1024));
+    fflush(stdout);
+    free_perft_table(&table);
+}
+
+// the usual perft positions, with their counts from depth 1
+// default_depth keeps the whole suite under a second, deep adds one ply to each (about 20 s)
+typedef struct
+{
+    const char *name;
+    const char *fen;
+    int default_depth;
+    uint64_t nodes[7];
+} PerftCase;
+
+static const PerftCase perft_cases[] = {
+    {"start position", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5, {20, 400, 8902, 197281, 4865609, 119060324, 3195901860ULL}},
+    {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4, {48, 2039, 97862, 4085603, 193690690, 8031647685ULL, 0}},
+    {"position 3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5, {14, 191, 2812, 43238, 674624, 11030083, 178633661}},
+    {"position 4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4, {6, 264, 9467, 422333, 15833292, 706045033, 0}},
+    {"position 4 mirrored", "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1", 4, {6, 264, 9467, 422333, 15833292, 706045033, 0}},
+    {"position 5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4, {44, 1486, 62379, 2103487, 89941194, 0, 0}},
+    {"position 6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 9", 4, {46, 2079, 89890, 3894594, 164075551, 6923051137ULL, 0}},
+};
+
+// run every position of the suite, print pass or fail with the speed, return true if all pass
+bool perft_suite(int threads, size_t hash_mb, bool deep)
+{
+    PerftTable table = {0};
+    if (hash_mb > 0 && !init_perft_table(&table, hash_mb))
+    {
+        fprintf(stderr, "could not allocate a %zu MB perft table, going without\n", hash_mb);
+    }
+    int nb_cases = sizeof(perft_cases) / sizeof(perft_cases[0]);
+    int failed = 0;
+    uint64_t total_nodes = 0;
+    double total_time = 0;
+    for (int c = 0; c < nb_cases; c++)
+    {
+        const PerftCase *perft_case = &perft_cases[c];
+        int depth = perft_case->default_depth + deep;
+        if (perft_case->nodes[depth - 1] == 0)
+        {
+            depth--;
+        }
+        char fen[128];
+        strncpy(fen, perft_case->fen, sizeof(fen) - 1);
+        fen[sizeof(fen) - 1] = '\0';
+        BoardState *board_s = FEN_to_board(fen);
+        if (board_s == NULL)
+        {
+            failed++;
+            continue;
+        }
+        // entries of another position can't be wrongly hit, but a fresh table keeps the timings comparable
+        if (table.entries != NULL)
+        {
+            memset(table.entries, 0, table.size * sizeof(PerftEntry));
+        }
+        double start = get_time();
+        uint64_t nodes = perft_divide(board_s, depth, threads, &table, false);
+        double time_taken = get_time() - start;
+        free(board_s);
+        bool pass = nodes == perft_case->nodes[depth - 1];
+        failed += !pass;
+        total_nodes += nodes;
+        total_time += time_taken;
+        printf("%-20s depth %d: %12llu nodes, expected %12llu, %s, %.3f s, %.0f nps\n", perft_case->name, depth, (unsigned long long)nodes,
+               (unsigned long long)perft_case->nodes[depth - 1], pass ? "pass" : "FAIL", time_taken, time_taken > 0 ? nodes / time_taken : 0.0);
+        fflush(stdout);
+    }
+    printf("perft suite: %d/%d passed, %llu nodes, %.3f s, %.0f nps, threads: %d, hash: %zu MB\n", nb_cases - failed, nb_cases, (unsigned long long)total_nodes, total_time,
+           total_time > 0 ? total_nodes / total_time : 0.0, threads, table.size * sizeof(PerftEntry) / (1024 * 1024));
+    fflush(stdout);
+    free_perft_table(&table);
+    return failed == 0;
+}
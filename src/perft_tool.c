@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "chess_logic.h"
+#include "bitboards_moves.h"
+#include "eval.h"
+#include "perft.h"
+
+// the move generator on its own, without the uci loop:
+// perft [-t <threads>] [-h <hash MB>] [-d] runs the suite, -d one ply deeper
+// perft "<fen>" <depth> [-t <threads>] [-h <hash MB>] divides that position
+int main(int argc, char *argv[])
+{
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t hash_mb = 64;
+    bool deep = false;
+    char *fen = NULL;
+    int depth = 0;
+    int i = 1;
+    if (argc >= 3 && argv[1][0] != '-')
+    {
+        fen = argv[1];
+        depth = atoi(argv[2]);
+        i = 3;
+    }
+    for (; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-d") == 0)
+            deep = true;
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-h") == 0 && i + 1 < argc)
+            hash_mb = strtoull(argv[++i], NULL, 10);
+        else
+        {
+            fprintf(stderr, "usage: %s [\"<fen>\" <depth>] [-t <threads>] [-h <hash MB>] [-d]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (threads < 1)
+        threads = 1;
+    init_eval_tables();
+    init_bitboard_tables();
+
+    if (fen == NULL)
+    {
+        return perft_suite(threads, hash_mb, deep) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    BoardState *board_s = FEN_to_board(fen);
+    if (board_s == NULL || depth < 1)
+    {
+        fprintf(stderr, "invalid position or depth\n");
+        return EXIT_FAILURE;
+    }
+    perft_divide_report(board_s, depth, threads, hash_mb);
+    free(board_s);
+    return EXIT_SUCCESS;
+}
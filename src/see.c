@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "types.h"
+#include "chess_logic.h"
+#include "bitboards_moves.h"
+#include "see.h"
+
+// material only, the king is worth more than anything it could win
+static const int see_values[7] = {100, 300, 300, 500, 900, 20000, 0};
+
+// static exchange evaluation: material won by the player to move if move starts a series of captures on its
+// destination square, each side taking with its least valuable piece and free to stop when it no longer pays
+// the attackers are looked up again after each capture, so the sliders behind the piece that took join in (x-rays)
+// a king only takes when the other side has nothing left on the square
+int see(BoardState *board_s, Move move)
+{
+    int from = move_init_square(move);
+    int to = move_dest_square(move);
+    Coords init_coords = move_init_coords(move);
+    Coords dest_coords = move_dest_coords(move);
+    PieceType attacker = board_s->board[init_coords.x][init_coords.y].name;
+    PieceType victim = board_s->board[dest_coords.x][dest_coords.y].name;
+    Bitboard occupancy = board_s->color_bb[WHITE] | board_s->color_bb[BLACK];
+    // en passant: the pawn taken is beside the destination square
+    if (attacker == PAWN && victim == EMPTY_PIECE && init_coords.y != dest_coords.y)
+    {
+        victim = PAWN;
+        occupancy ^= 1ULL << (init_coords.x * 8 + 7 - dest_coords.y);
+    }
+    // gain[d]: material won by the side that makes the d-th capture, if the exchange stops after it
+    int gain[32];
+    int d = 0;
+    gain[0] = see_values[victim];
+    if (move_promotion(move) != EMPTY_PIECE)
+    {
+        gain[0] += see_values[move_promotion(move)] - see_values[PAWN];
+        attacker = move_promotion(move);
+    }
+    occupancy ^= 1ULL << from;
+    Color side = board_s->player;
+    Bitboard attackers = attackers_to(board_s, to, occupancy) & occupancy;
+    while (d < 31)
+    {
+        side ^= 1;
+        Bitboard side_attackers = attackers & board_s->color_bb[side];
+        if (side_attackers == 0)
+        {
+            break;
+        }
+        PieceType next = PAWN;
+        while ((side_attackers & board_s->all_pieces_bb[side][next]) == 0)
+        {
+            next++;
+        }
+        if (next == KING && (attackers & board_s->color_bb[side ^ 1]) != 0)
+        {
+            break;
+        }
+        d++;
+        gain[d] = see_values[attacker] - gain[d - 1];
+        Bitboard taker = side_attackers & board_s->all_pieces_bb[side][next];
+        occupancy ^= taker & -taker;
+        attackers = attackers_to(board_s, to, occupancy) & occupancy;
+        attacker = next;
+    }
+    // from the last capture back to the first, each side picks between taking and stopping
+    while (d > 0)
+    {
+        gain[d - 1] = -(-gain[d - 1] > gain[d] ? -gain[d - 1] : gain[d]);
+        d--;
+    }
+    return gain[0];
+}
+
+// positions with a capture whose exchange is known, with the values of see_values
+typedef struct
+{
+    const char *fen;
+    const char *move;
+    int value;
+} SeeCase;
+
+static const SeeCase see_cases[] = {
+    {"1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1", "e1e5", 100},           // free pawn
+    {"1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1", "d3e5", -200}, // batteries on both sides
+    {"4R3/2r3p1/5bk1/1p1r3p/p2PR1P1/P1BK1P2/1P6/8 b - - 0 1", "h5g4", 0},        // pawn for pawn
+    {"4R3/2r3p1/5bk1/1p1r1p1p/p2PR1P1/P1BK1P2/1P6/8 b - - 0 1", "h5g4", 0},      // then the rook stops
+    {"4r1k1/5pp1/nbp4p/1p2p2q/1P2P1b1/1BP2N1P/1B2QPPK/3R4 b - - 0 1", "g4f3", 0}, // queen x-ray behind the bishop
+    {"4k3/8/4p3/3p4/8/8/8/3QK3 w - - 0 1", "d1d5", -800},                        // queen for a defended pawn
+    {"3r2k1/3r4/8/3p4/8/8/3R4/3R2K1 w - - 0 1", "d2d5", -400},                   // doubled rooks against doubled rooks
+    {"4k3/8/2b5/3p4/4P3/5B2/8/4K3 w - - 0 1", "e4d5", 100},                      // bishop x-ray behind the pawn
+    {"4k3/8/8/3n4/8/8/8/3RK3 w - - 0 1", "d1d5", 300},                           // free knight
+    {"1nk5/P7/8/8/8/8/8/4K3 w - - 0 1", "a7b8q", 200},                           // promotion taken back by the king
+    {"8/8/3k4/3p4/8/8/3R4/3RK3 w - - 0 1", "d2d5", 100},                         // the king can't take back
+    {"4k3/8/2p5/3n4/4P3/8/8/4K3 w - - 0 1", "e4d5", 200},                        // knight for pawn
+    {"4k3/4p3/3n4/8/4N3/8/8/4K3 w - - 0 1", "e4d6", 0},                          // knight for knight
+    {"4k3/8/2p5/8/8/8/8/3QK3 w - - 0 1", "d1d5", -900},                          // quiet move to an attacked square
+};
+
+// run every position of the suite, print the value found against the expected one, return true if all match
+bool see_suite()
+{
+    int nb_cases = sizeof(see_cases) / sizeof(see_cases[0]);
+    int failed = 0;
+    for (int c = 0; c < nb_cases; c++)
+    {
+        const SeeCase *see_case = &see_cases[c];
+        char fen[128];
+        strncpy(fen, see_case->fen, sizeof(fen) - 1);
+        fen[sizeof(fen) - 1] = '\0';
+        BoardState *board_s = FEN_to_board(fen);
+        if (board_s == NULL)
+        {
+            failed++;
+            continue;
+        }
+        // the move is looked for among the legal ones, an illegal move of the suite fails
+        MoveList move_list;
+        possible_moves_bb(board_s, &move_list);
+        Move move = empty_move();
+        for (int i = 0; i < move_list.size; i++)
+        {
+            char move_str[6];
+            move_to_uci(move_list.moves[i], move_str);
+            if (strcmp(move_str, see_case->move) == 0)
+            {
+                move = move_list.moves[i];
+            }
+        }
+        int value = is_empty_move(move) ? 0 : see(board_s, move);
+        free(board_s);
+        bool pass = !is_empty_move(move) && value == see_case->value;
+        failed += !pass;
+        printf("%-60s %-6s see %6d, expected %6d, %s\n", see_case->fen, see_case->move, value, see_case->value, pass ? "pass" : "FAIL");
+    }
+    printf("see suite: %d/%d passed\n", nb_cases - failed, nb_cases);
+    fflush(stdout);
+    return failed == 0;
+}
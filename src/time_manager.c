@@ -0,0 +1,120 @@
+#include <time.h>
+
+#include "types.h"
+#include "time_manager.h"
+
+#define MOVE_OVERHEAD 0.01 // seconds lost between the engine and the GUI
+#define DEFAULT_MOVES_TO_GO 30
+#define MIN_THINKING_TIME 0.005
+
+// wall clock time in seconds, clock() would count the cpu time of every search thread
+double get_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// soft limit: the share of the remaining time for this move, checked between iterations
+// hard limit: a few soft limits but never more than a part of the clock, checked during the search
+void init_time_manager(TimeManager *tm, SearchLimits *limits, Color color, atomic_bool *pondering)
+{
+    double time_left = limits->time[color];
+    double increment = limits->increment[color];
+    tm->start_time = get_time();
+    tm->max_nodes = limits->nodes;
+    tm->timed = true;
+    tm->ponder = limits->ponder;
+    tm->pondering = pondering;
+    if (limits->movetime > 0)
+    {
+        double time = limits->movetime - MOVE_OVERHEAD;
+        if (time < MIN_THINKING_TIME)
+            time = MIN_THINKING_TIME;
+        tm->soft_limit = time;
+        tm->hard_limit = time;
+        return;
+    }
+    if (limits->infinite || time_left < 0 || (time_left == 0 && increment == 0))
+    {
+        // go infinite, or a depth, nodes or mate search without a clock
+        tm->timed = false;
+        tm->soft_limit = 0;
+        tm->hard_limit = 0;
+        return;
+    }
+    int moves_to_go = limits->movestogo > 0 ? limits->movestogo : DEFAULT_MOVES_TO_GO;
+    double usable = time_left - MOVE_OVERHEAD;
+    if (usable < MIN_THINKING_TIME)
+        usable = MIN_THINKING_TIME;
+    double soft = usable / moves_to_go + increment * 0.75;
+    double hard = soft * 4;
+    // never bet more than half of the clock on one move, or all of it on the last move before the time control
+    double max_share = moves_to_go == 1 ? 0.9 : 0.5;
+    if (hard > usable * max_share)
+        hard = usable * max_share;
+    if (soft > hard)
+        soft = hard;
+    if (soft < MIN_THINKING_TIME)
+        soft = MIN_THINKING_TIME;
+    if (hard < MIN_THINKING_TIME)
+        hard = MIN_THINKING_TIME;
+    tm->soft_limit = soft;
+    tm->hard_limit = hard;
+}
+
+// the time spent pondering was the opponent's, our clock starts at ponderhit
+// only the main search thread calls it, the uci thread just clears the flag
+bool is_pondering(TimeManager *tm)
+{
+    if (!tm->ponder)
+    {
+        return false;
+    }
+    if (atomic_load(tm->pondering))
+    {
+        return true;
+    }
+    tm->ponder = false;
+    tm->start_time = get_time();
+    return false;
+}
+
+// called every TIME_CHECK_INTERVAL nodes of the main search and the quiescence search by the main thread
+bool time_is_up(TimeManager *tm, uint64_t nodes)
+{
+    if (is_pondering(tm))
+    {
+        return false;
+    }
+    if (tm->max_nodes > 0 && nodes >= tm->max_nodes)
+    {
+        return true;
+    }
+    return tm->timed && get_time() - tm->start_time > tm->hard_limit;
+}
+
+// the next iteration costs about the last one times the growth seen between the last two
+// it is not started past the soft limit, nor when it would be cut by the hard limit anyway
+bool can_start_iteration(TimeManager *tm, double last_iteration_time, double previous_iteration_time)
+{
+    if (is_pondering(tm) || !tm->timed)
+    {
+        return true;
+    }
+    double elapsed = get_time() - tm->start_time;
+    if (elapsed > tm->soft_limit)
+    {
+        return false;
+    }
+    double growth = 4;
+    if (previous_iteration_time > 0.0005)
+    {
+        growth = last_iteration_time / previous_iteration_time;
+        if (growth < 1.5)
+            growth = 1.5;
+        if (growth > 8)
+            growth = 8;
+    }
+    return elapsed + last_iteration_time * growth <= tm->hard_limit;
+}
@@ -1,4 +1,8 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include "types.h"
 #include "transposition_tables.h"
@@ -37,61 +41,300 @@ uint64_t get_zobrist_hash(BoardState *board_s)
     return hash;
 }
 
-void initialize_transposition_table(TranspoTable *table, size_t size)
+// same keys as get_zobrist_hash but for the pawns only
+uint64_t get_pawn_zobrist_hash(BoardState *board_s)
 {
-    table->size = size;
-    table->entries = (TranspoTableEntry *)calloc(size, sizeof(TranspoTableEntry));
+    uint64_t hash = 0;
+    for (int color = WHITE; color <= BLACK; color++)
+    {
+        Bitboard pawns = board_s->all_pieces_bb[color][PAWN];
+        while (pawns)
+        {
+            Coords co = square_to_coords(__builtin_ctzll(pawns));
+            hash ^= zobrist_table[(PAWN + color * 6) * 64 + co.x * 8 + co.y];
+            pawns &= pawns - 1;
+        }
+    }
+    return hash;
+}
+
+#define TT_KEY_SHIFT 48
+#define TT_GENERATION_MASK 63
+
+#define HUGE_PAGE_SIZE (2ULL * 1024 * 1024)
+#define PARALLEL_CLEAR_MIN_SIZE (64ULL * 1024 * 1024)
+
+// a large table is spread over 2 MB pages when the system allows it, fewer TLB misses on random probes
+// explicit huge pages first (MAP_HUGETLB needs pages reserved by the admin), then transparent huge pages
+static void *allocate_table_memory(size_t bytes, void **memory, size_t *memory_size)
+{
+    bytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+#ifdef MAP_HUGETLB
+    void *mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED)
+    {
+        fprintf(stderr, "transposition table: %zu MB on explicit huge pages\n", bytes >> 20);
+        *memory = mem;
+        *memory_size = bytes;
+        return mem;
+    }
+#endif
+    // one extra huge page to align the table on a 2 MB boundary
+    size_t mapped = bytes + HUGE_PAGE_SIZE;
+    char *base = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        return NULL;
+    }
+    char *aligned = (char *)(((uintptr_t)base + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, bytes, MADV_HUGEPAGE);
+#endif
+    fprintf(stderr, "transposition table: %zu MB, transparent huge pages advised\n", bytes >> 20);
+    *memory = base;
+    *memory_size = mapped;
+    return aligned;
 }
 
 void free_transposition_table(TranspoTable *table)
 {
-    free(table->entries);
-    table->entries = NULL;
+    if (table->memory != NULL)
+    {
+        munmap(table->memory, table->memory_size);
+    }
+    table->memory = NULL;
+    table->memory_size = 0;
+    table->buckets = NULL;
+    table->size = 0;
+}
+
+typedef struct
+{
+    char *start;
+    size_t size;
+} TableSlice;
+
+static void *clear_table_slice(void *arg)
+{
+    TableSlice *slice = (TableSlice *)arg;
+    memset(slice->start, 0, slice->size);
+    return NULL;
+}
+
+// zero the table, split between threads when it is large
+// it also touches every page of a fresh table so that the search doesn't pay the page faults
+void clear_transposition_table(TranspoTable *table, int threads)
+{
+    size_t bytes = table->size * sizeof(TranspoTableBucket);
+    if (bytes < PARALLEL_CLEAR_MIN_SIZE || threads < 1)
+    {
+        threads = 1;
+    }
+    if (threads > MAX_THREADS)
+    {
+        threads = MAX_THREADS;
+    }
+    pthread_t thread_ids[MAX_THREADS];
+    bool running[MAX_THREADS] = {false};
+    TableSlice slices[MAX_THREADS];
+    size_t slice_size = (bytes / threads + 63) & ~(size_t)63;
+    for (int t = 0; t < threads; t++)
+    {
+        size_t offset = t * slice_size;
+        slices[t].start = (char *)table->buckets + offset;
+        slices[t].size = offset >= bytes ? 0 : (bytes - offset < slice_size ? bytes - offset : slice_size);
+        // the calling thread takes the first slice, and any slice a thread could not be started for
+        running[t] = t > 0 && pthread_create(&thread_ids[t], NULL, clear_table_slice, &slices[t]) == 0;
+        if (!running[t])
+        {
+            clear_table_slice(&slices[t]);
+        }
+    }
+    for (int t = 1; t < threads; t++)
+    {
+        if (running[t])
+        {
+            pthread_join(thread_ids[t], NULL);
+        }
+    }
+    table->generation = 0;
+}
+
+// size_mb megabytes rounded down to a power of two of buckets, the previous table is freed
+// threads is the number of threads used to clear the new table
+bool resize_transposition_table(TranspoTable *table, size_t size_mb, int threads)
+{
+    size_t bytes = size_mb << 20;
+    size_t buckets = 1;
+    while (buckets * 2 * sizeof(TranspoTableBucket) <= bytes)
+    {
+        buckets *= 2;
+    }
+    free_transposition_table(table);
+    table->buckets = allocate_table_memory(buckets * sizeof(TranspoTableBucket), &table->memory, &table->memory_size);
+    if (table->buckets == NULL)
+    {
+        fprintf(stderr, "could not allocate a %zu MB transposition table\n", size_mb);
+        return false;
+    }
+    table->size = buckets;
+    clear_transposition_table(table, threads);
+    return true;
+}
+
+void initialize_transposition_table(TranspoTable *table, size_t size_mb)
+{
+    table->buckets = NULL;
+    table->memory = NULL;
+    table->memory_size = 0;
     table->size = 0;
+    table->generation = 0;
+    resize_transposition_table(table, size_mb, 1);
+}
+
+// a new search, the entries left by the previous ones age by one generation
+void new_search_generation(TranspoTable *table)
+{
+    table->generation = (table->generation + 1) & TT_GENERATION_MASK;
+}
+
+// the low bits of the hash choose the bucket, the high bits are the key kept in the entry
+TranspoTableBucket *get_transposition_table_bucket(TranspoTable *table, uint64_t hash)
+{
+    return &table->buckets[hash & (table->size - 1)];
+}
+
+static uint64_t tt_pack(uint64_t hash, Score score, int depth, Move best_move, Flag flag, uint8_t generation)
+{
+    uint64_t entry = hash >> TT_KEY_SHIFT << TT_KEY_SHIFT;
+    entry |= (uint64_t)best_move << 32;
+    entry |= (uint64_t)(uint16_t)score << 16;
+    entry |= (uint64_t)(depth & 0xFF) << 8;
+    entry |= (uint64_t)(generation & TT_GENERATION_MASK) << 2;
+    entry |= flag;
+    return entry;
+}
+
+static bool tt_key_matches(uint64_t entry, uint64_t hash)
+{
+    return entry != 0 && (entry >> TT_KEY_SHIFT) == (hash >> TT_KEY_SHIFT);
+}
+
+static Move tt_move(uint64_t entry)
+{
+    return (Move)(entry >> 32);
+}
+
+static Score tt_score(uint64_t entry)
+{
+    return (int16_t)(entry >> 16);
+}
+
+static int tt_depth(uint64_t entry)
+{
+    return (entry >> 8) & 0xFF;
 }
 
-size_t get_transposition_table_index(TranspoTable *table, uint64_t hash)
+static Flag tt_flag(uint64_t entry)
 {
-    return hash % table->size;
+    return entry & 3;
 }
 
-TranspoTableEntry *get_transposition_table_entry(TranspoTable *table, uint64_t hash)
+// an entry is worth keeping for its depth, less so for every search it has been left unused
+static int tt_replace_value(TranspoTable *table, uint64_t entry)
 {
-    size_t index = get_transposition_table_index(table, hash);
-    return &table->entries[index];
+    int age = (table->generation - (int)((entry >> 2) & TT_GENERATION_MASK)) & TT_GENERATION_MASK;
+    return tt_depth(entry) - 8 * age;
 }
 
+// the entry of the same position is overwritten, otherwise the least valuable entry of the bucket
 void store_transposition_table_entry(TranspoTable *table, uint64_t hash, Score score, int depth, Move best_move, Flag flag)
 {
-    size_t index = get_transposition_table_index(table, hash);
-    TranspoTableEntry *entry = &table->entries[index];
-    entry->hash = hash;
-    entry->score = score;
-    entry->depth = depth;
-    entry->best_move = best_move;
-    entry->flag = flag;
+    TranspoTableBucket *bucket = get_transposition_table_bucket(table, hash);
+    TranspoTableEntry *replaced = &bucket->entries[0];
+    int replaced_value = 1 << 30;
+    for (int i = 0; i < TT_BUCKET_ENTRIES; i++)
+    {
+        uint64_t entry = atomic_load_explicit(&bucket->entries[i], memory_order_relaxed);
+        if (tt_key_matches(entry, hash))
+        {
+            // a search that ended without a move doesn't erase the one found before
+            if (is_empty_move(best_move))
+            {
+                best_move = tt_move(entry);
+            }
+            replaced = &bucket->entries[i];
+            break;
+        }
+        int value = entry == 0 ? -(1 << 30) : tt_replace_value(table, entry);
+        if (value < replaced_value)
+        {
+            replaced = &bucket->entries[i];
+            replaced_value = value;
+        }
+    }
+    atomic_store_explicit(replaced, tt_pack(hash, score, depth, best_move, flag, table->generation), memory_order_relaxed);
 }
 
-bool tt_lookup(TranspoTable *table, uint64_t hash, int depth_to_go, int alpha, int beta, int *score, Move *best_move) {
-    TranspoTableEntry *entry = get_transposition_table_entry(table, hash);
+// found tells if the position was in the table, best_move is then its move, even when the entry can't give a cutoff
+bool tt_lookup(TranspoTable *table, uint64_t hash, int depth_to_go, int alpha, int beta, int *score, Move *best_move, bool *found)
+{
+    TranspoTableBucket *bucket = get_transposition_table_bucket(table, hash);
+    uint64_t entry = 0;
+    *found = false;
+    for (int i = 0; i < TT_BUCKET_ENTRIES; i++)
+    {
+        // one load per entry, another thread may be writing the bucket
+        uint64_t candidate = atomic_load_explicit(&bucket->entries[i], memory_order_relaxed);
+        if (tt_key_matches(candidate, hash))
+        {
+            entry = candidate;
+            *found = true;
+            break;
+        }
+    }
+    if (!*found)
+    {
+        return false;
+    }
 
-    if (entry->hash == hash && entry->depth >= depth_to_go && entry->score != 0) {
+    // the move is worth trying first even when the entry can't give a cutoff
+    *best_move = tt_move(entry);
+    Score entry_score = tt_score(entry);
+    if (tt_depth(entry) >= depth_to_go && entry_score != 0) {
         // Avoid using entries with zero score (could be polluted by contexts like threefold repetition)
-        if (entry->flag == EXACT) {
-            *score = entry->score;
-            *best_move = entry->best_move;
+        if (tt_flag(entry) == EXACT) {
+            *score = entry_score;
             return true;
         }
-        if (entry->flag == LOWERBOUND && entry->score >= beta) {
-            *score = entry->score;
-            *best_move = entry->best_move;
+        if (tt_flag(entry) == LOWERBOUND && entry_score >= beta) {
+            *score = entry_score;
             return true;
         }
-        if (entry->flag == UPPERBOUND && entry->score <= alpha) {
-            *score = entry->score;
-            *best_move = entry->best_move;
+        if (tt_flag(entry) == UPPERBOUND && entry_score <= alpha) {
+            *score = entry_score;
             return true;
         }
     }
     return false;
-}
\ No newline at end of file
+}
+
+// permill of the first thousand entries written by the current search, the UCI hashfull estimate
+int hashfull(TranspoTable *table)
+{
+    int used = 0;
+    int sampled = 0;
+    for (size_t b = 0; b < table->size && sampled < 1000; b++)
+    {
+        for (int i = 0; i < TT_BUCKET_ENTRIES && sampled < 1000; i++)
+        {
+            uint64_t entry = atomic_load_explicit(&table->buckets[b].entries[i], memory_order_relaxed);
+            if (entry != 0 && ((entry >> 2) & TT_GENERATION_MASK) == table->generation)
+            {
+                used++;
+            }
+            sampled++;
+        }
+    }
+    return sampled ? used * 1000 / sampled : 0;
+}
@@ -0,0 +1,545 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "chess_logic.h"
+#include "bitboards_moves.h"
+#include "eval.h"
+#include "datagen.h"
+#include "time_manager.h"
+
+// Texel tuning of the hand set weights of eval.c
+// the eval is linear in its weights: each position is turned once into the count of each weight (white minus black),
+// then every epoch is a pass over these flat coefficients, split between the threads, with no call to eval.
+// the error is the mean squared difference between the game results and the sigmoid of the eval, minimized with Adam.
+//
+// usage: builds/tune <positions> [-o <output.c>] [-e <epochs>] [-t <threads>] [-r <learning rate>]
+// positions: the records of datagen (a .bin file), or text lines with a FEN and the result of the game
+// as [1.0], [0.5], [0.0] or "1-0", "1/2-1/2", "0-1". the output holds the tuned definitions to put in eval.c
+
+// material then piece square tables, with a middle game and an endgame weight each
+#define TAPERED_PARAMS (6 + 6 * 64)
+#define MG_INDEX(i) (i)
+#define EG_INDEX(i) (TAPERED_PARAMS + (i))
+#define PST_INDEX(name, x, y) (6 + (name) * 64 + (x) * 8 + (y))
+// then the weights that don't depend on the phase
+#define PASSED_INDEX (2 * TAPERED_PARAMS)
+#define ISOLATED_INDEX (PASSED_INDEX + 8)
+#define DOUBLED_INDEX (ISOLATED_INDEX + 1)
+#define PROTECTED_INDEX (DOUBLED_INDEX + 1)
+#define CASTLING_INDEX (PROTECTED_INDEX + 1)
+#define UNCASTLED_INDEX (CASTLING_INDEX + 1)
+#define NB_PARAMS (UNCASTLED_INDEX + 1)
+
+#define DEFAULT_EPOCHS 2000
+#define DEFAULT_LEARNING_RATE 1.0
+#define REPORT_EPOCHS 100
+
+// a weight used by a position, index < TAPERED_PARAMS for the tapered ones
+typedef struct
+{
+    uint16_t index;
+    int16_t count;
+} Coefficient;
+
+typedef struct
+{
+    float mg_phase; // share of the middle game weights, the endgame ones get the rest
+    float result;   // for white: 1 win, 0.5 draw, 0 loss
+    int16_t eval;   // eval() of the position, to check the coefficients
+    uint32_t first; // its coefficients in the flat array
+    uint16_t nb_coefficients;
+} TunePosition;
+
+typedef struct
+{
+    TunePosition *positions;
+    Coefficient *coefficients;
+    size_t nb_positions;
+    size_t nb_coefficients;
+    size_t capacity_positions;
+    size_t capacity_coefficients;
+} TuneData;
+
+// the share of the positions of one thread, with what it sums
+typedef struct
+{
+    TuneData *data;
+    const double *params;
+    double k;
+    size_t begin;
+    size_t end;
+    bool with_gradient;
+    double error;
+    double gradient[NB_PARAMS];
+} TuneJob;
+
+static void initial_params(double *params)
+{
+    for (int name = 0; name < 6; name++)
+    {
+        params[MG_INDEX(name)] = PIECES_VALUES_MG[name];
+        params[EG_INDEX(name)] = PIECES_VALUES_EG[name];
+        for (int x = 0; x < 8; x++)
+        {
+            for (int y = 0; y < 8; y++)
+            {
+                params[MG_INDEX(PST_INDEX(name, x, y))] = PESTO_TABLE_MG[name][x][y];
+                params[EG_INDEX(PST_INDEX(name, x, y))] = PESTO_TABLE_EG[name][x][y];
+            }
+        }
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        params[PASSED_INDEX + i] = passed_pawn_bonus[i];
+    }
+    params[ISOLATED_INDEX] = ISOLATED_PAWN_PENALTY;
+    params[DOUBLED_INDEX] = DOUBLED_PAWN_PENALTY;
+    params[PROTECTED_INDEX] = PROTECTED_PAWN_BONUS;
+    params[CASTLING_INDEX] = CASTLING_RIGHTS_BONUS;
+    params[UNCASTLED_INDEX] = UNCASTLED_KING_PENALTY;
+}
+
+// the counts of the weights in eval(board_s), white minus black, penalties counted negatively
+static void count_params(BoardState *board_s, int *counts)
+{
+    memset(counts, 0, NB_PARAMS * sizeof(int));
+    for (int x = 0; x < 8; x++)
+    {
+        for (int y = 0; y < 8; y++)
+        {
+            Piece piece = board_s->board[x][y];
+            if (is_empty(piece))
+            {
+                continue;
+            }
+            // the tables are written for white, black reads them with its ranks flipped, like init_eval_tables
+            int sign = piece.color == WHITE ? 1 : -1;
+            counts[piece.name] += sign;
+            counts[PST_INDEX(piece.name, piece.color == WHITE ? x : 7 - x, y)] += sign;
+        }
+    }
+    PawnTermCounts pawns[2];
+    pawn_structure_terms(board_s, pawns);
+    // the eval only gives the bonus to advancements 1 to 6
+    for (int advancement = 1; advancement < 7; advancement++)
+    {
+        counts[PASSED_INDEX + advancement] = pawns[WHITE].passed[advancement] - pawns[BLACK].passed[advancement];
+    }
+    counts[ISOLATED_INDEX] = -(pawns[WHITE].isolated - pawns[BLACK].isolated);
+    counts[DOUBLED_INDEX] = -(pawns[WHITE].doubled - pawns[BLACK].doubled);
+    counts[PROTECTED_INDEX] = pawns[WHITE].protected - pawns[BLACK].protected;
+    int rights[2], uncastled[2];
+    castle_terms(board_s, rights, uncastled);
+    counts[CASTLING_INDEX] = rights[WHITE] - rights[BLACK];
+    counts[UNCASTLED_INDEX] = -(uncastled[WHITE] - uncastled[BLACK]);
+}
+
+static bool add_position(TuneData *data, BoardState *board_s, float result)
+{
+    if (data->nb_positions == data->capacity_positions)
+    {
+        size_t capacity = data->capacity_positions ? 2 * data->capacity_positions : 1 << 16;
+        TunePosition *positions = realloc(data->positions, capacity * sizeof(TunePosition));
+        if (positions == NULL)
+            return false;
+        data->positions = positions;
+        data->capacity_positions = capacity;
+    }
+    if (data->nb_coefficients + NB_PARAMS > data->capacity_coefficients)
+    {
+        size_t capacity = data->capacity_coefficients ? 2 * data->capacity_coefficients : 1 << 20;
+        Coefficient *coefficients = realloc(data->coefficients, capacity * sizeof(Coefficient));
+        if (coefficients == NULL)
+            return false;
+        data->coefficients = coefficients;
+        data->capacity_coefficients = capacity;
+    }
+    int counts[NB_PARAMS];
+    count_params(board_s, counts);
+    TunePosition *position = &data->positions[data->nb_positions++];
+    int mg_phase = board_s->phase > 24 ? 24 : board_s->phase;
+    position->mg_phase = mg_phase / 24.0f;
+    position->result = result;
+    position->eval = eval(board_s, NULL);
+    position->first = data->nb_coefficients;
+    position->nb_coefficients = 0;
+    for (int i = 0; i < NB_PARAMS; i++)
+    {
+        if (counts[i] != 0)
+        {
+            data->coefficients[data->nb_coefficients++] = (Coefficient){i, counts[i]};
+            position->nb_coefficients++;
+        }
+    }
+    return true;
+}
+
+// the result of a text line: [1.0] and the like, or the PGN result
+static bool parse_result(char *line, float *result)
+{
+    char *bracket = strchr(line, '[');
+    if (bracket != NULL)
+    {
+        *result = atof(bracket + 1);
+        return true;
+    }
+    if (strstr(line, "1/2-1/2") != NULL)
+        *result = 0.5f;
+    else if (strstr(line, "1-0") != NULL)
+        *result = 1.0f;
+    else if (strstr(line, "0-1") != NULL)
+        *result = 0.0f;
+    else
+        return false;
+    return true;
+}
+
+static bool load_text(FILE *file, TuneData *data)
+{
+    char line[512];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        float result;
+        if (!parse_result(line, &result))
+        {
+            continue;
+        }
+        // the four fields of the position, with counters that FEN_to_board can always read
+        char fen[160] = {0};
+        char *fields[4];
+        char *save;
+        fields[0] = strtok_r(line, " ", &save);
+        for (int i = 1; i < 4; i++)
+            fields[i] = fields[i - 1] != NULL ? strtok_r(NULL, " ", &save) : NULL;
+        if (fields[3] == NULL)
+        {
+            continue;
+        }
+        snprintf(fen, sizeof(fen), "%s %s %s %s 0 1", fields[0], fields[1], fields[2], fields[3]);
+        BoardState *board_s = FEN_to_board(fen);
+        if (board_s == NULL)
+            return false;
+        bool added = add_position(data, board_s, result);
+        free(board_s);
+        if (!added)
+            return false;
+    }
+    return true;
+}
+
+static bool load_records(FILE *file, TuneData *data)
+{
+    DataRecord records[4096];
+    size_t nb_read;
+    while ((nb_read = fread(records, sizeof(DataRecord), 4096, file)) > 0)
+    {
+        for (size_t i = 0; i < nb_read; i++)
+        {
+            BoardState *board_s = record_to_board(&records[i]);
+            if (board_s == NULL)
+                return false;
+            bool added = add_position(data, board_s, records[i].result / 2.0f);
+            free(board_s);
+            if (!added)
+                return false;
+        }
+    }
+    return true;
+}
+
+static double linear_eval(TuneData *data, TunePosition *position, const double *params)
+{
+    double mg = 0, eg = 0, flat = 0;
+    Coefficient *coefficients = &data->coefficients[position->first];
+    for (int i = 0; i < position->nb_coefficients; i++)
+    {
+        int index = coefficients[i].index;
+        if (index < TAPERED_PARAMS)
+        {
+            mg += coefficients[i].count * params[MG_INDEX(index)];
+            eg += coefficients[i].count * params[EG_INDEX(index)];
+        }
+        else
+        {
+            flat += coefficients[i].count * params[index];
+        }
+    }
+    return mg * position->mg_phase + eg * (1 - position->mg_phase) + flat;
+}
+
+// win probability of an eval, with the scale k fitted to the data
+static double sigmoid(double k, double score)
+{
+    return 1.0 / (1.0 + pow(10.0, -k * score / 400.0));
+}
+
+static void *tune_worker(void *arg)
+{
+    TuneJob *job = (TuneJob *)arg;
+    TuneData *data = job->data;
+    job->error = 0;
+    if (job->with_gradient)
+    {
+        memset(job->gradient, 0, sizeof(job->gradient));
+    }
+    for (size_t p = job->begin; p < job->end; p++)
+    {
+        TunePosition *position = &data->positions[p];
+        double s = sigmoid(job->k, linear_eval(data, position, job->params));
+        double difference = position->result - s;
+        job->error += difference * difference;
+        if (!job->with_gradient)
+        {
+            continue;
+        }
+        // derivative of the squared error with respect to the eval, the constant factors are left to the learning rate
+        double g = -difference * s * (1 - s);
+        Coefficient *coefficients = &data->coefficients[position->first];
+        for (int i = 0; i < position->nb_coefficients; i++)
+        {
+            int index = coefficients[i].index;
+            double count = coefficients[i].count;
+            if (index < TAPERED_PARAMS)
+            {
+                job->gradient[MG_INDEX(index)] += g * count * position->mg_phase;
+                job->gradient[EG_INDEX(index)] += g * count * (1 - position->mg_phase);
+            }
+            else
+            {
+                job->gradient[index] += g * count;
+            }
+        }
+    }
+    return NULL;
+}
+
+// mean error of the data set, and the summed gradient if gradient isn't NULL
+static double total_error(TuneData *data, const double *params, double k, int threads, double *gradient)
+{
+    TuneJob *jobs = malloc(threads * sizeof(TuneJob));
+    pthread_t *thread_ids = malloc(threads * sizeof(pthread_t));
+    bool *started = calloc(threads, sizeof(bool));
+    if (jobs == NULL || thread_ids == NULL || started == NULL)
+    {
+        fprintf(stderr, "could not allocate the tuning threads\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t share = (data->nb_positions + threads - 1) / threads;
+    for (int t = 0; t < threads; t++)
+    {
+        jobs[t].data = data;
+        jobs[t].params = params;
+        jobs[t].k = k;
+        jobs[t].begin = t * share < data->nb_positions ? t * share : data->nb_positions;
+        jobs[t].end = (t + 1) * share < data->nb_positions ? (t + 1) * share : data->nb_positions;
+        jobs[t].with_gradient = gradient != NULL;
+    }
+    // the first share is done on this thread, a share whose thread can't start too
+    for (int t = 1; t < threads; t++)
+    {
+        started[t] = pthread_create(&thread_ids[t], NULL, tune_worker, &jobs[t]) == 0;
+        if (!started[t])
+        {
+            tune_worker(&jobs[t]);
+        }
+    }
+    tune_worker(&jobs[0]);
+    double error = 0;
+    if (gradient != NULL)
+    {
+        memset(gradient, 0, NB_PARAMS * sizeof(double));
+    }
+    for (int t = 0; t < threads; t++)
+    {
+        if (started[t])
+        {
+            pthread_join(thread_ids[t], NULL);
+        }
+        error += jobs[t].error;
+        if (gradient != NULL)
+        {
+            for (int i = 0; i < NB_PARAMS; i++)
+                gradient[i] += jobs[t].gradient[i];
+        }
+    }
+    free(started);
+    free(jobs);
+    free(thread_ids);
+    return error / data->nb_positions;
+}
+
+// the scale of the sigmoid that fits the results best with the weights as they are, by ternary search
+static double fit_k(TuneData *data, const double *params, int threads)
+{
+    double low = 0.1, high = 4.0;
+    for (int i = 0; i < 40; i++)
+    {
+        double a = low + (high - low) / 3;
+        double b = high - (high - low) / 3;
+        if (total_error(data, params, a, threads, NULL) < total_error(data, params, b, threads, NULL))
+            high = b;
+        else
+            low = a;
+    }
+    return (low + high) / 2;
+}
+
+static void write_table(FILE *file, const char *name, const double *params, int piece, bool endgame)
+{
+    fprintf(file, "const int %s_TABLE_%s[8][8] = {\n", name, endgame ? "EG" : "MG");
+    for (int x = 0; x < 8; x++)
+    {
+        fprintf(file, "    {");
+        for (int y = 0; y < 8; y++)
+        {
+            int index = PST_INDEX(piece, x, y);
+            fprintf(file, "%4ld%s", lround(params[endgame ? EG_INDEX(index) : MG_INDEX(index)]), y < 7 ? ", " : "");
+        }
+        fprintf(file, "},\n");
+    }
+    fprintf(file, "};\n\n");
+}
+
+// the definitions of eval.c with the tuned values, in the same layout
+static bool write_params(const char *path, const double *params, size_t nb_positions, double k, double start_error, double end_error)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        perror("tune");
+        return false;
+    }
+    const char *names[6] = {"PAWN", "KNIGHT", "BISHOP", "ROOK", "QUEEN", "KING"};
+    fprintf(file, "// tuned on %zu positions, k = %.4f, mean squared error %.6f -> %.6f\n\n", nb_positions, k, start_error, end_error);
+    for (int endgame = 0; endgame < 2; endgame++)
+    {
+        fprintf(file, "const int PIECES_VALUES_%s[6] = {", endgame ? "EG" : "MG");
+        for (int name = 0; name < 6; name++)
+            fprintf(file, "%ld%s", lround(params[endgame ? EG_INDEX(name) : MG_INDEX(name)]), name < 5 ? ", " : "};\n");
+    }
+    fprintf(file, "\nconst int passed_pawn_bonus[8] = {");
+    for (int i = 0; i < 8; i++)
+        fprintf(file, "%ld%s", lround(params[PASSED_INDEX + i]), i < 7 ? ", " : "};\n");
+    fprintf(file, "const int ISOLATED_PAWN_PENALTY = %ld;\n", lround(params[ISOLATED_INDEX]));
+    fprintf(file, "const int DOUBLED_PAWN_PENALTY = %ld;\n", lround(params[DOUBLED_INDEX]));
+    fprintf(file, "const int PROTECTED_PAWN_BONUS = %ld;\n", lround(params[PROTECTED_INDEX]));
+    fprintf(file, "const int CASTLING_RIGHTS_BONUS = %ld;\n", lround(params[CASTLING_INDEX]));
+    fprintf(file, "const int UNCASTLED_KING_PENALTY = %ld;\n\n", lround(params[UNCASTLED_INDEX]));
+    for (int name = 0; name < 6; name++)
+    {
+        write_table(file, names[name], params, name, false);
+        write_table(file, names[name], params, name, true);
+    }
+    return fclose(file) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <positions> [-o <output.c>] [-e <epochs>] [-t <threads>] [-r <learning rate>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *output = "tuned_eval.c";
+    int epochs = DEFAULT_EPOCHS;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    double learning_rate = DEFAULT_LEARNING_RATE;
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-o") == 0)
+            output = argv[i + 1];
+        else if (strcmp(argv[i], "-e") == 0)
+            epochs = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-t") == 0)
+            threads = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-r") == 0)
+            learning_rate = atof(argv[i + 1]);
+        else
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+    }
+    if (threads < 1)
+        threads = 1;
+    init_eval_tables();
+    init_bitboard_tables();
+
+    FILE *file = fopen(argv[1], "rb");
+    if (file == NULL)
+    {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    TuneData data = {0};
+    size_t length = strlen(argv[1]);
+    bool records = length > 4 && strcmp(argv[1] + length - 4, ".bin") == 0;
+    double start = get_time();
+    bool loaded = records ? load_records(file, &data) : load_text(file, &data);
+    fclose(file);
+    if (!loaded || data.nb_positions == 0)
+    {
+        fprintf(stderr, "no positions loaded from %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    printf("%zu positions, %.1f coefficients per position, loaded in %.1f s\n", data.nb_positions, (double)data.nb_coefficients / data.nb_positions, get_time() - start);
+
+    double params[NB_PARAMS];
+    initial_params(params);
+    // with the weights of eval.c the coefficients must give eval back, but for its integer divisions
+    double max_difference = 0;
+    for (size_t p = 0; p < data.nb_positions && p < 100000; p++)
+    {
+        double difference = fabs(linear_eval(&data, &data.positions[p], params) - data.positions[p].eval);
+        if (difference > max_difference)
+            max_difference = difference;
+    }
+    printf("largest difference with eval(): %.2f\n", max_difference);
+    double k = fit_k(&data, params, threads);
+    double start_error = total_error(&data, params, k, threads, NULL);
+    printf("k = %.4f, error %.6f, %d threads\n", k, start_error, threads);
+
+    // Adam, with the moments of each weight
+    double gradient[NB_PARAMS];
+    double *momentum = calloc(NB_PARAMS, sizeof(double));
+    double *velocity = calloc(NB_PARAMS, sizeof(double));
+    if (momentum == NULL || velocity == NULL)
+    {
+        fprintf(stderr, "could not allocate the optimizer\n");
+        return EXIT_FAILURE;
+    }
+    const double beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+    double error = start_error;
+    start = get_time();
+    for (int epoch = 1; epoch <= epochs; epoch++)
+    {
+        error = total_error(&data, params, k, threads, gradient);
+        for (int i = 0; i < NB_PARAMS; i++)
+        {
+            double g = gradient[i] / data.nb_positions;
+            momentum[i] = beta1 * momentum[i] + (1 - beta1) * g;
+            velocity[i] = beta2 * velocity[i] + (1 - beta2) * g * g;
+            double m = momentum[i] / (1 - pow(beta1, epoch));
+            double v = velocity[i] / (1 - pow(beta2, epoch));
+            params[i] -= learning_rate * m / (sqrt(v) + epsilon);
+        }
+        if (epoch % REPORT_EPOCHS == 0 || epoch == epochs)
+        {
+            printf("epoch %d, error %.6f, %.2f s per epoch\n", epoch, error, (get_time() - start) / epoch);
+            fflush(stdout);
+        }
+    }
+    error = total_error(&data, params, k, threads, NULL);
+    if (!write_params(output, params, data.nb_positions, k, start_error, error))
+    {
+        return EXIT_FAILURE;
+    }
+    printf("error %.6f -> %.6f, written to %s\n", start_error, error, output);
+    free(momentum);
+    free(velocity);
+    free(data.positions);
+    free(data.coefficients);
+    return EXIT_SUCCESS;
+}